@@ -0,0 +1,144 @@
+//  Binary_oarchive and Binary_iarchive are minimal archives for the classes' existing boost-style
+//  serialize() members (ar & member), used by save_pop()/load_pop() for compact checkpoints.
+//
+//  Numbers are stored as raw bytes in native byte order, and a vector of numbers as its length
+//  followed by one block copy, so a population's lineage and org arrays move in a few memcpy's.
+//  Binary_oarchive collects everything in one buffer, to be written with a single write.
+//  Binary_iarchive reads from any byte range, e.g. a memory-mapped file.
+//
+//  Supported members: arithmetic types, fixed-size arrays and std::vector/std::map of supported
+//  types, and classes with a serialize(Archive&, unsigned int) member.  A std::array is stored
+//  exactly as a std::vector of the same elements, so either may read what the other wrote.
+
+
+#ifndef _BINARY_ARCHIVE_
+#define _BINARY_ARCHIVE_
+
+#include <array>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <iostream>
+#include <stdlib.h>
+#include <type_traits>
+#include <boost/serialization/access.hpp>
+
+namespace evolve {
+
+// ****************************************************************************
+// ********************          Binary_oarchive         ********************
+// ****************************************************************************
+class Binary_oarchive {
+public:
+  template<class T> Binary_oarchive& operator&(const T& t) {save(t); return *this; };
+  template<class T> Binary_oarchive& operator<<(const T& t) {save(t); return *this; };
+
+  void save_bytes(const void* p, size_t n) {
+    const char* c = static_cast<const char*>(p);
+    buf.insert(buf.end(), c, c + n);
+  };
+  const std::vector<char>& buffer() const {return buf; };
+private:
+  std::vector<char> buf;
+
+  template<class T> void save(const T& t) {save(t, std::is_arithmetic<T>()); };
+  template<class T> void save(const T& t, std::true_type)  {save_bytes(&t, sizeof(T)); };
+  template<class T> void save(const T& t, std::false_type) {   // class with serialize()
+    boost::serialization::access::serialize(*this, const_cast<T&>(t), 0);
+  };
+
+  template<class T, size_t N> void save(const T (&a)[N]) {
+    for (size_t i = 0; i < N; ++i) save(a[i]);
+  };
+  template<class T> void save(const std::vector<T>& v) {
+    save((unsigned long long) v.size());
+    save_elements(v, std::is_arithmetic<T>());
+  };
+  template<class T> void save_elements(const std::vector<T>& v, std::true_type) {
+    if (not v.empty()) save_bytes(&v[0], v.size() * sizeof(T));
+  };
+  template<class T> void save_elements(const std::vector<T>& v, std::false_type) {
+    for (size_t i = 0; i < v.size(); ++i) save(v[i]);
+  };
+  template<class T, size_t N> void save(const std::array<T, N>& a) {
+    save((unsigned long long) N);
+    for (size_t i = 0; i < N; ++i) save(a[i]);
+  };
+  template<class K, class V> void save(const std::map<K, V>& m) {
+    save((unsigned long long) m.size());
+    for (typename std::map<K, V>::const_iterator it = m.begin(); it != m.end(); ++it) {
+      save(it->first);
+      save(it->second);
+    };
+  };
+};
+
+
+// ****************************************************************************
+// ********************          Binary_iarchive         ********************
+// ****************************************************************************
+class Binary_iarchive {
+public:
+  Binary_iarchive(const char* begin, const char* end) : pos(begin), stop(end) {};
+
+  template<class T> Binary_iarchive& operator&(T& t)  {load(t); return *this; };
+  template<class T> Binary_iarchive& operator>>(T& t) {load(t); return *this; };
+
+  void load_bytes(void* p, size_t n) {
+    if (n > (size_t)(stop - pos)) {
+      std::cout << "Binary_iarchive: unexpected end of data." << std::endl;
+      abort();
+    };
+    memcpy(p, pos, n);
+    pos += n;
+  };
+  size_t bytes_left() const {return stop - pos; };
+private:
+  const char* pos;
+  const char* stop;
+
+  template<class T> void load(T& t) {load(t, std::is_arithmetic<T>()); };
+  template<class T> void load(T& t, std::true_type)  {load_bytes(&t, sizeof(T)); };
+  template<class T> void load(T& t, std::false_type) {
+    boost::serialization::access::serialize(*this, t, 0);
+  };
+
+  template<class T, size_t N> void load(T (&a)[N]) {
+    for (size_t i = 0; i < N; ++i) load(a[i]);
+  };
+  template<class T> void load(std::vector<T>& v) {
+    unsigned long long n;
+    load(n);
+    v.resize(n);
+    load_elements(v, std::is_arithmetic<T>());
+  };
+  template<class T> void load_elements(std::vector<T>& v, std::true_type) {
+    if (not v.empty()) load_bytes(&v[0], v.size() * sizeof(T));
+  };
+  template<class T> void load_elements(std::vector<T>& v, std::false_type) {
+    for (size_t i = 0; i < v.size(); ++i) load(v[i]);
+  };
+  template<class T, size_t N> void load(std::array<T, N>& a) {
+    unsigned long long n;
+    load(n);
+    if (n != N) {
+      std::cout << "Binary_iarchive: expected " << N << " elements, not " << n << "." << std::endl;
+      abort();
+    };
+    for (size_t i = 0; i < N; ++i) load(a[i]);
+  };
+  template<class K, class V> void load(std::map<K, V>& m) {
+    unsigned long long n;
+    load(n);
+    m.clear();
+    for (unsigned long long i = 0; i < n; ++i) {
+      K key;
+      load(key);
+      load(m[key]);
+    };
+  };
+};
+
+} //end of evolve namespace
+
+#endif
@@ -0,0 +1,411 @@
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <assert.h>
+#include <algorithm>
+
+#include "paths.hpp"
+#include CLASS_POPULATION
+#include ORGANISM
+#include RV_GENERATORS
+
+namespace evolve{
+
+Class_population::Class_population()
+  : counts        (6 * Organism::num_states()),
+    b_rates       (6 * Organism::num_states()),
+    ev_rates      (6 * Organism::num_states()),
+    st_counts     (Organism::num_states()),
+    tot_event_rate     (0.0),
+    tot_b_rate         (0.0),
+    tot_sq_b_rate      (0.0),
+    n_orgs             (0),
+    n_births           (0),
+    gens               (0.0),
+    pop_cap            (0),
+    n_deaths           (0),
+    n_state_chg        (0),
+    n_trk_orgs         (0),
+    n_trk_births       (0),
+    n_trk_deaths       (0),
+    n_trk_state_chg    (0),
+    n_leaps            (0),
+    n_exact_steps      (0) {
+  for (int cls = 0; cls < num_classes(); ++cls) {
+    const Org_state& os = Organism::state(class_state(cls));
+    b_rates[cls]  = os.birth_rate(class_allele(cls));
+    ev_rates[cls] = b_rates[cls] + os.death_rate() + os.chg_rate();
+  };
+};
+
+template<int N>
+Class_population::Class_population(const Basic_population<N>& pop) {
+  *this = Class_population();
+  set_pop_capacity(pop.pop_capacity());
+  set_rng(pop.rng());
+  for (int st = 0; st < Organism::num_states(); ++st)
+    for (int i = 0; i < pop.num_in_state(st); ++i)
+      add_to_class(class_index(pop.org(st, i).allele_state(), pop.org(st, i).tracked(), st), 1);
+  update_rates();
+};
+
+template Class_population::Class_population(const Population&);
+template Class_population::Class_population(const Population3&);
+
+double Class_population::death_rate() const {
+  double tot = 0;
+  for (int st=0; st < Organism::num_states(); ++st)
+    tot += (st_counts[st] * Organism::state(st).death_rate());
+  return tot;
+};
+
+void Class_population::reset_counts() {
+  n_births    = 0;
+  n_deaths    = 0;
+  n_state_chg = 0;
+  n_trk_births    = 0;
+  n_trk_deaths    = 0;
+  n_trk_state_chg = 0;
+};
+
+// Totals are recomputed from the integer counts, so they never drift.  This is O(#classes),
+// the same order as choosing the event.
+void Class_population::update_rates() {
+  tot_event_rate = 0.0;
+  tot_b_rate     = 0.0;
+  tot_sq_b_rate  = 0.0;
+  for (int cls = 0; cls < num_classes(); ++cls) {
+    tot_event_rate += counts[cls] * ev_rates[cls];
+    tot_b_rate     += counts[cls] * b_rates[cls];
+    tot_sq_b_rate  += counts[cls] * b_rates[cls] * b_rates[cls];
+  };
+};
+
+void Class_population::add_to_class(int cls, int num) {
+  assert(counts[cls] + num >= 0);
+  counts[cls] += num;
+  st_counts[class_state(cls)] += num;
+  n_orgs += num;
+  if (class_tracked(cls)) n_trk_orgs += num;
+};
+
+void Class_population::add_org(const Organism& org, int st) {add_orgs(org, st, 1); };
+
+void Class_population::add_orgs(const Organism& org, int st, int num) {
+  assert(num >= 0);
+  add_to_class(class_index(org.allele_state(), org.tracked(), st), num);
+  update_rates();
+};
+
+Class_population Class_population::branch(const Rng& rng) const {
+  Class_population copy(*this);
+  copy.set_rng(rng);
+  copy.reset_counts();
+  copy.gens = 0.0;
+  return copy;
+};
+
+void Class_population::inject_tracked(int num, int from_st, int to_st) {
+  assert(num <= num_in_state(from_st));
+  for (int i = 0; i < num; ++i) {
+    int ch = rnd_int(rand_gen, st_counts[from_st]);     // random org of from_st, by class
+    int cls = class_index(-1, false, from_st);
+    while ((ch -= counts[cls]) >= 0) ++cls;
+    assert(class_state(cls) == from_st);
+    add_to_class(cls, -1);
+    add_to_class(class_index(class_allele(cls), true, to_st), 1);
+  };
+  update_rates();
+};
+
+int Class_population::num_lineages() const {
+  int n = 0;
+  for (int cls = 0; cls < num_classes(); ++cls)
+    if (counts[cls] > 0) ++n;
+  return n;
+};
+
+void Class_population::birth(int cls) {
+  assert(counts[cls] > 0);
+  int st = class_state(cls);
+  int child_allele = Organism::mutant_allele(class_allele(cls), st, rand_gen);
+  add_to_class(class_index(child_allele, class_tracked(cls), st), 1);
+
+  ++n_births;
+  gens += (double)1/n_orgs;
+  if (class_tracked(cls)) ++n_trk_births;
+};
+
+void Class_population::death(int cls) {
+  assert(counts[cls] > 0);                      // someone here to kill
+  add_to_class(cls, -1);
+  ++n_deaths;
+  if (class_tracked(cls)) ++n_trk_deaths;
+};
+
+void Class_population::state_changer(int cls) {
+  // Like Population::state_changer: destination by the state's switching table
+  int st = class_state(cls);
+  assert(counts[cls] > 0);
+
+  int new_st = Organism::rnd_switch_dest(st, rand_gen);
+  add_to_class(cls, -1);
+  add_to_class(class_index(class_allele(cls), class_tracked(cls), new_st), 1);
+
+  ++n_state_chg;
+  if (class_tracked(cls)) ++n_trk_state_chg;
+};
+
+void Class_population::do_event() {
+  double ch = rnd_uniform(rand_gen) * event_rate();
+  int cls = 0;
+  while ((ch -= counts[cls] * ev_rates[cls]) > 0 and cls < num_classes() - 1) ++cls;
+  const Org_state& os = Organism::state(class_state(cls));
+
+  if ((ch += counts[cls] * b_rates[cls]) > 0) {
+    birth(cls);
+
+    int death_ch = rnd_int(rand_gen, num_orgs());   // Moran process: a random org dies
+    int death_cls = 0;
+    while ((death_ch -= counts[death_cls]) >= 0) ++death_cls;
+    death(death_cls);
+  }
+  else if ((ch += counts[cls] * os.death_rate()) > 0)
+    death(cls);
+
+  else
+    state_changer(cls);
+
+  update_rates();
+};
+
+// Step size by the species-based bound of Cao, Gillespie & Petzold (2006): the mean and variance
+// of each occupied class's change over tau must stay within eps times its count
+double Class_population::leap_size(double eps) const {
+  const int n_cls = num_classes();
+  std::vector<double> drift(n_cls, 0.0);
+  std::vector<double> var(n_cls, 0.0);
+  double probs[3];
+
+  for (int cls = 0; cls < n_cls; ++cls) {
+    if (counts[cls] == 0) continue;
+    int st = class_state(cls);
+    const Org_state& os = Organism::state(st);
+
+    double a_birth = counts[cls] * b_rates[cls];       // offspring, by mutant allele
+    Organism::mutant_allele_probs(class_allele(cls), st, probs);
+    for (int k = 0; k < 3; ++k) {
+      int dest = class_index(k - 1, class_tracked(cls), st);
+      drift[dest] += a_birth * probs[k];
+      var[dest]   += a_birth * probs[k];
+    };
+    double a_moran = tot_b_rate * counts[cls] / n_orgs;  // Moran deaths follow every birth
+    double a_death = counts[cls] * os.death_rate();
+    drift[cls] -= a_moran + a_death;
+    var[cls]   += a_moran + a_death;
+    for (int k = 0; k < Organism::num_switch_dests(st); ++k) {
+      double a_switch = counts[cls] * Organism::switch_rate(st, k);
+      int dest = class_index(class_allele(cls), class_tracked(cls), Organism::switch_dest(st, k));
+      drift[cls]  -= a_switch;
+      var[cls]    += a_switch;
+      drift[dest] += a_switch;
+      var[dest]   += a_switch;
+    };
+  };
+
+  double tau = HUGE_VAL;
+  for (int cls = 0; cls < n_cls; ++cls) {
+    if (counts[cls] == 0) continue;
+    double bound = std::max(eps * counts[cls] / 2.0, 1.0);  // highest order = 2 (Moran death)
+    if (drift[cls] != 0.0) tau = std::min(tau, bound / std::fabs(drift[cls]));
+    if (var[cls]   != 0.0) tau = std::min(tau, bound * bound / var[cls]);
+  };
+  return tau;
+};
+
+double Class_population::leap(double eps) {
+  assert(eps > 0.0);
+  // Leaping is too coarse near fixation or loss, and isn't worth it for a handful of events
+  bool exact = (n_trk_orgs     > 0 and n_trk_orgs     < leap_crit_count) 
+            or (num_wld_orgs() > 0 and num_wld_orgs() < leap_crit_count);
+  double tau = exact ? 0.0 : leap_size(eps);
+  if (exact or tau * event_rate() < leap_crit_count) {
+    ++n_exact_steps;
+    do_event();
+    return rnd_expo(rand_gen, event_rate());
+  };
+
+  const int n_cls = num_classes();
+  std::vector<int> delta(n_cls);
+  std::vector<int> moran_deaths;
+  std::vector<double> weights(counts.begin(), counts.end());
+  double probs[3];
+  int births, trk_births, deaths, trk_deaths, switches, trk_switches;
+  bool negative;
+  do {                                    // redraw with half the step if any count goes negative
+    std::fill(delta.begin(), delta.end(), 0);
+    births = trk_births = deaths = trk_deaths = switches = trk_switches = 0;
+    for (int cls = 0; cls < n_cls; ++cls) {
+      if (counts[cls] == 0) continue;
+      int st = class_state(cls);
+      const Org_state& os = Organism::state(st);
+      bool trk = class_tracked(cls);
+
+      int n_b = rnd_poisson(rand_gen, counts[cls] * b_rates[cls] * tau);
+      Organism::mutant_allele_probs(class_allele(cls), st, probs);
+      int left = n_b;                           // split offspring by allele with binomials
+      double p_left = 1.0;
+      for (int k = 0; k < 3 and left > 0; ++k) {
+        int n_k = (k == 2 or probs[k] >= p_left) ? left
+                  : rnd_binomial(rand_gen, probs[k] / p_left, left);
+        delta[class_index(k - 1, trk, st)] += n_k;
+        left   -= n_k;
+        p_left -= probs[k];
+      };
+      births += n_b;
+      if (trk) trk_births += n_b;
+
+      int n_d = rnd_poisson(rand_gen, counts[cls] * os.death_rate() * tau);
+      delta[cls] -= n_d;
+      deaths += n_d;
+      if (trk) trk_deaths += n_d;
+
+      for (int k = 0; k < Organism::num_switch_dests(st); ++k) {
+        int n_s = rnd_poisson(rand_gen, counts[cls] * Organism::switch_rate(st, k) * tau);
+        delta[cls] -= n_s;
+        delta[class_index(class_allele(cls), trk, Organism::switch_dest(st, k))] += n_s;
+        switches += n_s;
+        if (trk) trk_switches += n_s;
+      };
+    };
+
+    rnd_multinomial(rand_gen, births, weights, moran_deaths);   // one random death per birth
+    negative = false;
+    for (int cls = 0; cls < n_cls; ++cls) {
+      delta[cls] -= moran_deaths[cls];
+      if (class_tracked(cls)) trk_deaths += moran_deaths[cls];
+      if (counts[cls] + delta[cls] < 0) negative = true;
+    };
+    deaths += births;
+    if (negative) tau /= 2.0;
+  } while (negative);
+
+  for (int cls = 0; cls < n_cls; ++cls) add_to_class(cls, delta[cls]);
+  update_rates();
+
+  n_births    += births;
+  n_deaths    += deaths;
+  n_state_chg += switches;
+  n_trk_births    += trk_births;
+  n_trk_deaths    += trk_deaths;
+  n_trk_state_chg += trk_switches;
+  if (n_orgs > 0) gens += (double) births / n_orgs;
+  ++n_leaps;
+  return tau;
+};
+
+// A generation lasts as long as N Moran births would, N / (total birth rate).  Switching and death
+// during that time are applied to the offspring with the corresponding probabilities.
+double Class_population::wf_generation() {
+  if (n_orgs == 0) return HUGE_VAL;                        // extinct: start() stops
+  if (tot_b_rate <= 0.0) {                                 // time would never advance
+    std::cout << "wf_generation: no organism can reproduce, so no generation can follow." 
+              << std::endl;
+    abort();
+  };
+  const int n_cls = num_classes();
+  const double gen_time = n_orgs / tot_b_rate;
+
+  std::vector<double> weights(n_cls);
+  for (int cls = 0; cls < n_cls; ++cls) weights[cls] = counts[cls] * b_rates[cls];
+  std::vector<int> offspring;
+  rnd_multinomial(rand_gen, n_orgs, weights, offspring);
+
+  std::vector<int> next(n_cls, 0);
+  double probs[3];
+  int trk_births = 0;
+  for (int cls = 0; cls < n_cls; ++cls) {                  // mutation
+    if (offspring[cls] == 0) continue;
+    int st = class_state(cls);
+    Organism::mutant_allele_probs(class_allele(cls), st, probs);
+    int left = offspring[cls];
+    double p_left = 1.0;
+    for (int k = 0; k < 3 and left > 0; ++k) {
+      int n_k = (k == 2 or probs[k] >= p_left) ? left
+                : rnd_binomial(rand_gen, probs[k] / p_left, left);
+      next[class_index(k - 1, class_tracked(cls), st)] += n_k;
+      left   -= n_k;
+      p_left -= probs[k];
+    };
+    if (class_tracked(cls)) trk_births += offspring[cls];
+  };
+
+  int switches = 0, trk_switches = 0, culled = 0, trk_culled = 0;
+  std::vector<int> switched(n_cls, 0);
+  std::vector<double> dest_rates;
+  std::vector<int> n_to_dest;
+  for (int cls = 0; cls < n_cls; ++cls) {                  // switching, then death
+    if (next[cls] == 0) continue;
+    int st = class_state(cls);
+    const Org_state& os = Organism::state(st);
+    const int n_dests = Organism::num_switch_dests(st);
+    if (n_dests > 0 and os.chg_rate() > 0.0) {
+      int n_s = rnd_binomial(rand_gen, 1 - exp(-os.chg_rate() * gen_time), next[cls]);
+      next[cls] -= n_s;
+      if (n_dests == 1) n_to_dest.assign(1, n_s);
+      else {                                               // split by destination
+        dest_rates.resize(n_dests);
+        for (int k = 0; k < n_dests; ++k) dest_rates[k] = Organism::switch_rate(st, k);
+        rnd_multinomial(rand_gen, n_s, dest_rates, n_to_dest);
+      };
+      for (int k = 0; k < n_dests; ++k)
+        switched[class_index(class_allele(cls), class_tracked(cls), Organism::switch_dest(st, k))]
+          += n_to_dest[k];
+      switches += n_s;
+      if (class_tracked(cls)) trk_switches += n_s;
+    };
+  };
+  for (int cls = 0; cls < n_cls; ++cls) {
+    next[cls] += switched[cls];
+    const Org_state& os = Organism::state(class_state(cls));
+    if (next[cls] > 0 and os.death_rate() > 0.0) {
+      int n_d = rnd_binomial(rand_gen, 1 - exp(-os.death_rate() * gen_time), next[cls]);
+      next[cls] -= n_d;
+      culled += n_d;
+      if (class_tracked(cls)) trk_culled += n_d;
+    };
+  };
+
+  const int parents = n_orgs, trk_parents = n_trk_orgs;     // the old generation dies
+  for (int cls = 0; cls < n_cls; ++cls) add_to_class(cls, next[cls] - counts[cls]);
+  update_rates();
+
+  n_births    += parents;
+  n_deaths    += parents + culled;
+  n_state_chg += switches;
+  n_trk_births    += trk_births;
+  n_trk_deaths    += trk_parents + trk_culled;
+  n_trk_state_chg += trk_switches;
+  gens += 1.0;
+  return gen_time;
+};
+
+std::ostream& operator<<(std::ostream& out, const Class_population& pop) {
+  out << "|---  Class_population  -------------------------------------------|"
+      << std::endl
+      << "tot_event_rate = " << pop.event_rate()        << std::endl
+      << "tot_death_rate = " << pop.death_rate()        << std::endl
+      << "num_orgs       = " << pop.num_orgs()          << std::endl
+      << "num_trk_orgs   = " << pop.num_trk_orgs()      << std::endl
+      << "state  tracked  allele  count" << std::endl;
+  for (int cls = 0; cls < pop.num_classes(); ++cls)
+    if (pop.class_count(cls) > 0)
+      out << Class_population::class_state(cls)   << "\t"
+          << Class_population::class_tracked(cls) << "\t"
+          << Class_population::class_allele(cls)  << "\t"
+          << pop.class_count(cls)                 << std::endl;
+  return out;
+};
+
+}
@@ -0,0 +1,219 @@
+//  This header defines Class_population, a count-based alternative to Population.
+//
+//  In the present model an organism is fully described by its allele (+1, 0, -1), its tracking flag
+//  and its phenotypic state.  Class_population therefore stores only the number of organisms in each
+//  (allele, tracked, state) "genotype class", and no per-organism or per-lineage data.  Memory is
+//  constant in the census size, and do_event() costs O(number of classes), so very large Moran
+//  populations become feasible.
+//
+//  The dynamics are the same Poisson processes as in Population::do_event() (birth followed by a
+//  Moran death, death, and phenotypic switching), and the accessors used by Write_snapshot and the
+//  stopping conditions in experiment.hpp have the same names and meaning.  The one exception is
+//  num_lineages(), which counts occupied classes, because lineages identical by descent are not
+//  distinguished here.
+//
+//  leap() is an approximate alternative to do_event(): it advances all processes over a step tau
+//  with Poisson/binomial batches (tau-leaping), choosing tau so that no class's propensities are
+//  expected to change by more than a fraction eps.  Close to fixation or loss of the tracked
+//  organisms it falls back to exact events.
+//
+//  wf_generation() replaces the Moran dynamics by Wright-Fisher: the whole population is resampled
+//  at once, parents chosen multinomially in proportion to class birth rates, and offspring mutate,
+//  switch state and die with binomial draws.  Cost per generation is O(#classes), independent of N.
+
+
+#ifndef _CLASS_POPULATION_
+#define _CLASS_POPULATION_
+
+#include <vector>
+#include <iostream>
+#include <assert.h>
+#include <boost/serialization/vector.hpp>
+
+#include "paths.hpp"
+#include ORGANISM
+#include POPULATION
+#include RV_GENERATORS
+
+namespace evolve {
+
+class Class_population;                                        // defined below
+std::ostream& operator<<(std::ostream&, const Class_population&);
+
+// ****************************************************************************
+// ********************         Class_population         ********************
+// ****************************************************************************
+class Class_population {
+public:
+  Class_population();                             // Construct empty population
+  template<int NStates>                            // Collapse a population into its classes
+  explicit Class_population(const Basic_population<NStates>&);
+
+  void set_pop_capacity(int);
+  void set_rng(const Rng&);
+  Rng& rng() const;
+
+  void do_event();                          // Chooses which Poisson process occurs (birth/death,etc)
+  double leap(double eps);                  // tau-leap, returns the time advanced
+  double wf_generation();                   // one Wright-Fisher generation, returns time advanced
+
+  static const int leap_crit_count = 10;    // leap only while tracked and wild counts are above this
+  Class_population branch(const Rng&) const;              // as in Population
+  void inject_tracked(int num, int from_state, int to_state);
+  void add_org(const Organism& org, int state);          // only allele and tracking flag are used
+  void add_orgs(const Organism& org, int state, int num);
+
+  double event_rate() const;                 // birth + death  + change state
+  double birth_rate()             const;
+  double sum_squared_birth_rate() const;
+  double death_rate()             const;
+
+  int num_orgs()          const;                // Get info on population
+  int num_lineages()      const;                // number of occupied classes
+  int num_in_state(int)   const;
+  int num_births()        const;
+  int pop_capacity()      const;
+  int num_deaths()        const;
+  int num_state_chg()     const;
+  double generations()    const;
+
+  int num_trk_orgs()      const;
+  int num_trk_births()    const;
+  int num_trk_deaths()    const;
+  int num_trk_state_chg() const;
+
+  int num_wld_orgs()      const;
+  int num_wld_births()    const;
+  int num_wld_deaths()    const;
+  int num_wld_state_chg() const;
+
+  int num_leaps()         const;          // steps taken by leap() as a batch
+  int num_exact_steps()   const;          // steps leap() took as a single exact event
+
+  void reset_counts();            // Resets birth/death/state-chg counts
+
+  // Genotype classes, numbered ((state * 2 + tracked) * 3 + allele + 1)
+  int num_classes()              const;
+  int class_count(int cls)       const;
+  static int class_index(int allele, bool tracked, int state);
+  static int class_allele(int cls);
+  static bool class_tracked(int cls);
+  static int class_state(int cls);
+
+  friend std::ostream& operator<<(std::ostream& out, const Class_population& pop);
+private:
+  std::vector<int>    counts;        // Number of orgs in each class
+  std::vector<double> b_rates;       // Birth rate of one org in each class
+  std::vector<double> ev_rates;      // Total event rate of one org in each class
+  std::vector<int>    st_counts;     // Orgs in each state
+
+  double tot_event_rate;             // Rate totals, recomputed exactly from the counts
+  double tot_b_rate;
+  double tot_sq_b_rate;
+  mutable Rng rand_gen;
+
+  int n_orgs;                        // Counters, as in Population
+  int n_births;
+  double gens;
+  int pop_cap;
+  int n_deaths;
+  int n_state_chg;
+
+  int n_trk_orgs;
+  int n_trk_births;
+  int n_trk_deaths;
+  int n_trk_state_chg;
+  int n_leaps;
+  int n_exact_steps;
+
+  void birth(int cls);
+  void death(int cls);
+  void state_changer(int cls);
+
+  void add_to_class(int cls, int num);     // Helper functions
+  void update_rates();
+  double leap_size(double eps) const;
+
+  // Enable reading/writing of object to archive file
+  friend class boost::serialization::access;
+  template<class Archive>
+  void serialize(Archive & ar, const unsigned int version) {
+  ar & counts;
+  ar & b_rates;
+  ar & ev_rates;
+  ar & st_counts;
+  ar & tot_event_rate;
+  ar & tot_b_rate;
+  ar & tot_sq_b_rate;
+  ar & rand_gen;
+  ar & n_orgs;
+  ar & n_births;
+  ar & gens;
+  ar & pop_cap;
+  ar & n_deaths;
+  ar & n_state_chg;
+  ar & n_trk_orgs;
+  ar & n_trk_births;
+  ar & n_trk_deaths;
+  ar & n_trk_state_chg;
+  ar & n_leaps;
+  ar & n_exact_steps;
+  Organism::serialize_states(ar);
+  };
+};
+
+inline double Class_population::event_rate()    const {return tot_event_rate;  };
+inline double Class_population::birth_rate()    const {return tot_b_rate;      };
+inline double Class_population::sum_squared_birth_rate() const {return tot_sq_b_rate; };
+inline int    Class_population::num_orgs()      const {return n_orgs;          };
+inline int    Class_population::num_births()    const {return n_births;        };
+inline double Class_population::generations()   const {return gens;            };
+inline int    Class_population::pop_capacity()  const {return pop_cap;         };
+inline int    Class_population::num_deaths()    const {return n_deaths;        };
+inline int    Class_population::num_state_chg() const {return n_state_chg;     };
+inline int    Class_population::num_trk_orgs()  const {return n_trk_orgs;      };
+inline int    Class_population::num_classes()   const {return counts.size();   };
+inline int    Class_population::num_leaps()     const {return n_leaps;         };
+inline int    Class_population::num_exact_steps() const {return n_exact_steps; };
+
+inline int Class_population::num_trk_births()    const {return n_trk_births;           };
+inline int Class_population::num_trk_deaths()    const {return n_trk_deaths;           };
+inline int Class_population::num_trk_state_chg() const {return n_trk_state_chg;        };
+inline int Class_population::num_wld_orgs()      const {return n_orgs - n_trk_orgs;    };
+inline int Class_population::num_wld_births()    const {return n_births - n_trk_births;};
+inline int Class_population::num_wld_deaths()    const {return n_deaths - n_trk_deaths;};
+
+inline int Class_population::num_wld_state_chg() const {
+  return n_state_chg - n_trk_state_chg;
+};
+
+inline int Class_population::num_in_state(int st) const {
+  assert(st >= 0);
+  assert(st < Organism::num_states());
+  return st_counts[st];
+};
+
+inline int Class_population::class_count(int cls) const {
+  assert(cls >= 0);
+  assert(cls < (int) counts.size());
+  return counts[cls];
+};
+
+inline int Class_population::class_index(int allele, bool tracked, int st) {
+  assert(allele >= -1 and allele <= 1);
+  assert(st >= 0);
+  assert(st < Organism::num_states());
+  return (st * 2 + tracked) * 3 + allele + 1;
+};
+
+inline int  Class_population::class_allele(int cls)  {return cls % 3 - 1;       };
+inline bool Class_population::class_tracked(int cls) {return (cls / 3) % 2;     };
+inline int  Class_population::class_state(int cls)   {return cls / 6;           };
+
+inline void Class_population::set_pop_capacity(int p_cap) {pop_cap = p_cap;   };
+inline void Class_population::set_rng(const Rng& rng)     {rand_gen = rng;    };
+inline Rng& Class_population::rng()                 const {return rand_gen;   };
+
+} //end of evolve namespace
+
+#endif
@@ -0,0 +1,294 @@
+// Micro- and macro-benchmarks of the simulation engine, so that a performance change can be judged
+// against a baseline run of the same benchmark file.
+//
+// Micro-benchmarks time Population's event functions (do_event, birth, death, state_changer and
+// a pop_org/push_org pair), Organism::mutate and the random number generators, in
+// populations of n_min, 10 n_min, ... n_max organisms made of 1 or n/10 lineages.  Macro-benchmarks
+// time whole competition trials (as in driveCompete.cpp) and fixed-time runs, for the individual
+// and counts engines.  Each benchmark repeats batches of operations until it has run min_secs.
+// The individual engine is timed both as Population ("individual", any number of states) and as
+// Population3 ("individual3", compiled for 3 states).
+//
+// Results are one tab-separated line per benchmark, to stdout and results_filename:
+//   benchmark  engine  n_orgs  n_lineages  ops  seconds  ns_per_op  ops_per_sec
+//
+// usage:  benchmark.exe [name=value ...]    (overrides parameters_benchmark.txt)
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "paths.hpp"
+#include EXPERIMENT
+#include POPULATION
+#include CLASS_POPULATION
+#include ORGANISM
+#include RV_GENERATORS
+#include PARAMETERS
+
+using namespace evolve;
+using namespace std;
+
+namespace {
+  Parameters prm;
+  unsigned long long seed;
+  double min_secs;                                         // per benchmark
+  std::ofstream results;
+  volatile double sink;                                    // keeps timed results alive
+
+  class Stopwatch {
+  public:
+    Stopwatch() : t0( std::chrono::steady_clock::now() ) {};
+    double secs() const {
+      return std::chrono::duration<double>( std::chrono::steady_clock::now()- t0).count();
+    };
+  private:
+    std::chrono::steady_clock::time_point t0;
+  };
+
+  void report( std::string name, std::string engine, int n_orgs, int n_lineages, double ops,
+               double secs) {
+    std::ostringstream line;
+    line<< name<< "\t"<< engine<< "\t"<< n_orgs<< "\t"<< n_lineages<< "\t"<< ops<< "\t"<< secs
+        << "\t"<< 1e9* secs/ ops<< "\t"<< ops/ secs;
+    std::cout<< line.str()<< std::endl;
+    results<< line.str()<< std::endl;
+  };
+
+  // Repeats batch(n) until min_secs have been spent in it; batch returns the seconds it timed
+  template<class Batch>
+  void run_bench( std::string name, std::string engine, int n_orgs, int n_lineages, int n,
+                  Batch batch) {
+    double secs= 0, ops= 0;
+    while( secs< min_secs) {
+      secs+= batch( n);
+      ops+= n;
+    };
+    report( name, engine, n_orgs, n_lineages, ops, secs);
+  };
+}
+
+namespace evolve {
+// Times Basic_population's private event functions.  Each leaves the population's size and state
+// occupancy as it found them, doing the compensating operations (e.g. deaths after timed births)
+// outside the timed part.
+class Population_bench {
+public:
+  template<class Pop> static double do_event( Pop& pop, int n) {
+    Stopwatch t;
+    for( int i= 0; i< n; ++i) pop.do_event();
+    return t.secs();
+  };
+  template<class Pop> static double birth( Pop& pop, int n) {
+    Stopwatch t;
+    for( int i= 0; i< n; ++i) pop.birth( 1);
+    double secs= t.secs();
+    for( int i= 0; i< n; ++i) pop.death( 1);
+    return secs;
+  };
+  template<class Pop> static double death( Pop& pop, int n) {
+    for( int i= 0; i< n; ++i) pop.birth( 1);
+    Stopwatch t;
+    for( int i= 0; i< n; ++i) pop.death( 1);
+    return t.secs();
+  };
+  template<class Pop> static double state_changer( Pop& pop, int n) {
+    Stopwatch t;
+    for( int i= 0; i< n; ++i) pop.state_changer( 1+ ( i& 1) );   // 1 -> 2, then 2 -> 1
+    return t.secs();
+  };
+  template<class Pop> static double pop_push_org( Pop& pop, int n) {
+    const std::vector<Lineage_id>& orgs= pop.orgs[ 1][ genotype_index( 0)];   // all founders
+    Stopwatch t;
+    for( int i= 0; i< n; ++i) {
+      const int ch= i% orgs.size();
+      const Lineage_id id= orgs[ ch];
+      pop.pop_org( 1, genotype_index( 0), ch);
+      pop.push_org( id, 1);
+    };
+    return t.secs();
+  };
+  template<class Pop> static double mutate( const Pop& pop, int n) {
+    const int n_in_state= pop.num_in_state( 1);
+    Organism org;
+    double alleles= 0;
+    Stopwatch t;
+    for( int i= 0; i< n; ++i) {
+      org= pop.org( 1, i% n_in_state);
+      org.mutate( 1, pop.rng() );
+      alleles+= org.allele_state();
+    };
+    sink= alleles;
+    return t.secs();
+  };
+};
+}
+
+namespace {
+  // n orgs of n_lineages lineages, alternately in states 1 and 2; every other lineage tracked
+  template<class Pop>
+  Pop make_population( int n, int n_lineages, const Rng& rng) {
+    std::vector<Organism> founders( n_lineages);
+    for( int l= 0; l< n_lineages; ++l) founders[ l].set_tracked( l% 2);
+    Pop pop;
+    pop.set_pop_capacity( n);
+    pop.set_rng( rng);
+    for( int i= 0; i< n; ++i) pop.add_org( founders[ i% n_lineages], 1+ i% 2);
+    return pop;
+  };
+
+  // Each benchmark starts from its own copy of the population, since do_event changes the
+  // occupancy of the states that the others rely on
+  template<class Pop>
+  void population_benchmarks( std::string engine, int n, int n_lineages) {
+    const int batch= min( n, 1<< 16);
+    const Pop base= make_population<Pop>( n, n_lineages, Rng( seed, n_lineages) );
+    Pop pop;
+    pop= base;
+    run_bench( "do_event",         engine, n, n_lineages, batch,
+               [&]( int k) {return Population_bench::do_event( pop, k);         });
+    pop= base;
+    run_bench( "birth",            engine, n, n_lineages, batch,
+               [&]( int k) {return Population_bench::birth( pop, k);            });
+    pop= base;
+    run_bench( "death",            engine, n, n_lineages, batch,
+               [&]( int k) {return Population_bench::death( pop, k);            });
+    pop= base;
+    run_bench( "state_changer",    engine, n, n_lineages, batch,
+               [&]( int k) {return Population_bench::state_changer( pop, k);    });
+    pop= base;
+    run_bench( "pop_push_org",     engine, n, n_lineages, batch,
+               [&]( int k) {return Population_bench::pop_push_org( pop, k);     });
+    pop= base;
+    run_bench( "mutate",           engine, n, n_lineages, batch,
+               [&]( int k) {return Population_bench::mutate( pop, k);           });
+  };
+
+  // Random number primitives; n_orgs and n_lineages are 0
+  void rng_benchmarks() {
+    const int batch= 1<< 20;
+    Rng rng( seed, 0);
+    run_bench( "rng_next", "", 0, 0, batch, [&]( int k) {
+        unsigned long long x= 0;
+        Stopwatch t;
+        for( int i= 0; i< k; ++i) x^= rng.next();
+        sink= x;
+        return t.secs(); });
+    run_bench( "rnd_uniform", "", 0, 0, batch, [&]( int k) {
+        double x= 0;
+        Stopwatch t;
+        for( int i= 0; i< k; ++i) x+= rnd_uniform( rng);
+        sink= x;
+        return t.secs(); });
+    run_bench( "rnd_int", "", 0, 0, batch, [&]( int k) {
+        double x= 0;
+        Stopwatch t;
+        for( int i= 0; i< k; ++i) x+= rnd_int( rng, 1000);
+        sink= x;
+        return t.secs(); });
+    run_bench( "rnd_expo", "", 0, 0, batch, [&]( int k) {
+        double x= 0;
+        Stopwatch t;
+        for( int i= 0; i< k; ++i) x+= rnd_expo( rng, 1.0);
+        sink= x;
+        return t.secs(); });
+    run_bench( "rnd_binomial", "", 0, 0, batch, [&]( int k) {
+        double x= 0;
+        Stopwatch t;
+        for( int i= 0; i< k; ++i) x+= rnd_binomial( rng, 0.01, 1000);
+        sink= x;
+        return t.secs(); });
+    run_bench( "rnd_poisson", "", 0, 0, batch, [&]( int k) {
+        double x= 0;
+        Stopwatch t;
+        for( int i= 0; i< k; ++i) x+= rnd_poisson( rng, 10.0);
+        sink= x;
+        return t.secs(); });
+  };
+
+  // Competition trials as in driveCompete.cpp, trial i with random stream i
+  template<class Pop>
+  void compete_benchmark( std::string engine) {
+    const int pop_capacity= prm.get_int( "pop_capacity");
+    const int cells_init_tracked= prm.get_int( "cells_init_tracked");
+    int itrial= 0;
+    run_bench( "compete_trial", engine, pop_capacity, 0, 100, [&]( int k) {
+        double fixed= 0;
+        Stopwatch t;
+        for( int i= 0; i< k; ++i, ++itrial) {
+          Organism org_w;                                      // fresh: add_org() ties an org
+          Organism org_t;                                      // to the population's lineages
+          org_t.set_tracked(1);
+          Pop pop;
+          pop.set_pop_capacity( pop_capacity);
+          pop.set_rng( Rng( seed, itrial) );
+          for( int j= 0; j< pop_capacity- cells_init_tracked; ++j) pop.add_org( org_w, 0);
+          for( int j= 0; j< cells_init_tracked; ++j) pop.add_org( org_t, 1);
+          Basic_experiment<Pop> exp;
+          exp.set_population( pop);
+          exp.start( fixed_or_lost, never);
+          fixed+= exp.population().num_wld_orgs() == 0;
+        };
+        sink= fixed;
+        return t.secs(); });
+  };
+
+  // Wild-type population of n evolved for fixed_time_gens generations; ops are generations
+  template<class Pop>
+  void fixed_time_benchmark( std::string engine, int n) {
+    const double gens= prm.get_double( "fixed_time_gens");
+    Organism org_w;
+    Pop pop;
+    pop.set_pop_capacity( n);
+    pop.set_rng( Rng( seed, n) );
+    for( int j= 0; j< n; ++j) pop.add_org( org_w, 0);
+
+    double secs= 0, ops= 0;
+    while( secs< min_secs) {
+      Basic_experiment<Pop> exp;
+      exp.set_population( pop);
+      Stopwatch t;
+      exp.start( Generations_since_start( gens), never);
+      secs+= t.secs();
+      ops+= exp.population().generations();
+    };
+    report( "fixed_time_gen", engine, n, 0, ops, secs);
+  };
+}
+
+int main( int argc, char** argv) {
+  prm= Parameters( "parameters_benchmark.txt");
+  prm.override_from( argc, argv);
+  seed= prm.get_uint64( "seed");
+  min_secs= prm.get_double( "min_secs");
+  results.open( prm.get_string( "results_filename").c_str() );
+
+  Organism::add_states(3);
+  for( int st= 0; st< 3; ++st) Organism::set_state_params( st, prm);
+
+  const std::string header= "benchmark\tengine\tn_orgs\tn_lineages\tops\tseconds\tns_per_op\tops_per_sec";
+  std::cout<< header<< std::endl;
+  results<< header<< std::endl;
+
+  rng_benchmarks();
+  for( int n= prm.get_int( "n_min"); n<= prm.get_int( "n_max"); n*= 10) {
+    population_benchmarks<Population>(  "individual",  n, 1);
+    population_benchmarks<Population>(  "individual",  n, max( 1, n/ 10) );
+    population_benchmarks<Population3>( "individual3", n, 1);
+    population_benchmarks<Population3>( "individual3", n, max( 1, n/ 10) );
+  };
+
+  compete_benchmark<Population>( "individual");
+  compete_benchmark<Population3>( "individual3");
+  compete_benchmark<Class_population>( "counts");
+  for( int n= prm.get_int( "n_min"); n<= prm.get_int( "n_max"); n*= 10) {
+    fixed_time_benchmark<Population>( "individual", n);
+    fixed_time_benchmark<Population3>( "individual3", n);
+    fixed_time_benchmark<Class_population>( "counts", n);
+  };
+  return 0;
+};
@@ -15,52 +15,172 @@
 #include RV_GENERATORS
 #include TEMP_TEMPLATES
 #include PARAMETERS
+#include TRIAL_RUNNER
+#include TRAJECTORY
 
 using namespace evolve;
 using namespace std;
  
 namespace {          
   using namespace evolve;
-  evolve::Parameters prm  ("parameters_compete.txt");      // Create parameter object from file
-}
- 
-int main() {
-
-  //clock_t start_time= clock();                        // Start program timing clock
-  long seed = time( NULL)+ getpid();                  // Get random number generator seed 
-  srand48( seed);                                     // Seed random number generator
-  //std::cout<< "seed= "<< seed<< std::endl;
-  //cout<<prm;
+  evolve::Parameters prm;                                  // parameters_compete.txt + command line
+  unsigned long long seed;                                 // master seed, trial i uses stream i
+  Stepping stepping= exact_events;
+  double leap_eps;                                         // tau-leaping accuracy
+  bool from_burned= false;                                 // branch trials off a burned-in pop.
+  Population3      burned;                                 // wild-type pop. after burn-in
+  Class_population burned_counts;                          // same, for the counts engines
   
-  Organism::add_states(3);   
+  Trajectory_file* traj_file= 0;                           // binary trajectories of all trials
+  double report_dt;
   
-  Organism::set_state_params(0, prm);                           // connect Parameters to Organism
+  void branch_burned( Population3& pop, int itrial)      {pop= burned.branch( Rng( seed, itrial) );        };
+  void branch_burned( Class_population& pop, int itrial) {pop= burned_counts.branch( Rng( seed, itrial) ); };
+}
 
-  Organism::set_state_params(1, prm);
-  Organism::set_state_params(2, prm);
-  int numFix= 0;
-  
-  for( int itrial= 0; itrial< prm.get_int("trials"); ++itrial){
+// One competition trial; returns 1 if the tracked organisms fixed, 0 if they were lost.  Pop is
+// the population engine: Population3 (individuals and lineages, 3 states) or Class_population
+// (counts).
+template<class Pop>
+double compete_trial( int itrial) {
 	  Organism org_w;                                                // Empty genome, pnat_product= 1 
 	  Organism org_t;
 	  org_t.set_tracked(1);
 	  
-	  Population pop;                                               // create Population      
-	  pop.set_pop_capacity( prm.get_int( "pop_capacity") );
+	  Pop pop;                                                      // create Population      
+	  if( from_burned) {                                            // standing variation, no rebuild
+	    branch_burned( pop, itrial);
+	    pop.inject_tracked( prm.get_int( "cells_init_tracked"), 0, 1);
+	  }
+	  else {
+	  const int pop_capacity= prm.get_int( "pop_capacity");
+	  const int cells_init_tracked= prm.get_int( "cells_init_tracked");
+	  pop.set_pop_capacity( pop_capacity);
+	  pop.set_rng( Rng( seed, itrial) );                          // reproducible whatever the thread
    
-		for( int i= 0; i< prm.get_int( "pop_capacity")- prm.get_int( "cells_init_tracked"); ++i)                
+		for( int i= 0; i< pop_capacity- cells_init_tracked; ++i)                
 		  pop.add_org( org_w, 0);          
-		for( int i= 0; i< prm.get_int( "cells_init_tracked"); ++i)
+		for( int i= 0; i< cells_init_tracked; ++i)
 		  pop.add_org( org_t, 1);   
+	  };
 		// ------------------------------------------------------------------------
-		Experiment exp;                                                    // Create experiment
-		exp.set_population( pop).set_stop_cond( fixed_or_lost);
-		exp.start();
-		if (exp.population().num_wld_orgs() == 0) ++numFix;
+		Basic_experiment<Pop> exp;                                         // Create experiment
+		exp.set_population( std::move( pop) );                           // moved in, not copied
+		if( stepping == tau_leaping)   exp.set_tau_leap( leap_eps);
+		if( stepping == wright_fisher) exp.set_wright_fisher();
+		if( stepping == next_reaction) exp.set_next_reaction();
+		if( traj_file) {                                                   // one buffer per trial
+		  Trajectory_writer traj( *traj_file, itrial);
+		  Write_trajectory write( traj);
+		  if( prm.get_bool( "report_at_start")) exp.set_pre_snapshot( write);
+		  if( prm.get_bool( "report_during"))   exp.set_snapshot( write);
+		  exp.set_post_snapshot( Sync_trajectory( traj) );                 // trial's records written
+		  exp.start( fixed_or_lost, Time_since_last_snapshot( report_dt) );
+		}
+		else exp.start( fixed_or_lost, never);                             // checks inlined in loop
+		return exp.population().num_wld_orgs() == 0;
+};
+ 
+// Every parameter driveCompete reads from parameters_compete.txt
+std::vector<std::string> compete_param_names() {
+  const char* names[] = {"trials", "threads", "seed", "engine", "tau_leap_eps", "burn_in_gens",
+                         "burn_in_file", "write_trajectory", "trajectory_filename", "async_output",
+                         "summary_filename", "report_at_start", "report_during", "report_at_end",
+                         "report_dt", "report_dgen", "pop_capacity", "cells_init_tracked"};
+  std::vector<std::string> all( names, names+ sizeof( names)/ sizeof( names[ 0]) );
+  for( int st= 0; st< 3; ++st) {
+    std::vector<std::string> state_names= Organism::state_param_names( st);
+    all.insert( all.end(), state_names.begin(), state_names.end() );
+  };
+  return all;
+};
+
+// Parameters it may read: the switching tables, which the states must have been added for
+std::vector<std::string> compete_optional_names() {
+  std::vector<std::string> all;
+  for( int st= 0; st< Organism::num_states(); ++st) {
+    std::vector<std::string> switch_names= Organism::switch_param_names( st);
+    all.insert( all.end(), switch_names.begin(), switch_names.end() );
+  };
+  return all;
+};
+ 
+// usage:  compete.exe [name=value ...]    (overrides parameters_compete.txt)
+int main( int argc, char** argv) {
+
+  //clock_t start_time= clock();                        // Start program timing clock
+  prm= Parameters( "parameters_compete.txt");
+  prm.override_from( argc, argv);
+  Organism::add_states(3);   
+  prm.check_names( compete_param_names(), compete_optional_names() );           // typos caught before any trial runs
+  
+  seed = prm.get_uint64( "seed");                        // Get random number generator seed 
+  if( seed == 0) seed = time( NULL)+ getpid();        // 0 means pick one, logged for reruns
+  std::cerr<< "seed= "<< seed<< std::endl;
+  //cout<<prm;
+  
+  Organism::set_state_params(0, prm);                           // connect Parameters to Organism
+
+  Organism::set_state_params(1, prm);
+  Organism::set_state_params(2, prm);
+  
+  std::vector<double> fixed;                                    // outcome of each trial
+  std::string engine= prm.get_string( "engine");
+  leap_eps= prm.get_double( "tau_leap_eps");
+  stepping= engine_stepping( engine);                           // aborts on unknown engines
+  Trial_fn trial= counts_engine( engine) ? compete_trial<Class_population> : compete_trial<Population3>;
+  
+  // Optionally burn in (or load) one wild-type population and branch every trial off it
+  std::string burn_in_file= prm.get_string( "burn_in_file");
+  double burn_in_gens= prm.get_double( "burn_in_gens");
+  from_burned= ( burn_in_file != "none" or burn_in_gens > 0);
+  if( burn_in_file != "none") {
+    std::vector<Org_state> configured;                        // load_pop() replaces the states
+    for( int st= 0; st< Organism::num_states(); ++st) configured.push_back( Organism::state( st) );
+    load_pop( burned, burn_in_file);
+    if( Organism::num_states() != (int) configured.size() ) {
+      std::cout<< burn_in_file<< " has "<< Organism::num_states()<< " organism states, not "
+               << configured.size()<< "."<< std::endl;
+      abort();
     };
+    for( int st= 0; st< Organism::num_states(); ++st)
+      if( Organism::state( st) != configured[ st]) {
+        std::cout<< "State "<< st<< " of "<< burn_in_file<< " doesn't match the parameters:"<< std::endl
+                 << "in the file:"<< std::endl<< Organism::state( st)
+                 << "configured:"<< std::endl<< configured[ st];
+        abort();
+      };
+  }
+  else if( burn_in_gens > 0) {
+    Organism org_w;
+    Population3 pop;
+    pop.set_pop_capacity( prm.get_int( "pop_capacity") );
+    pop.set_rng( Rng( seed, ~0ULL) );                         // a stream no trial uses
+    for( int i= 0; i< prm.get_int( "pop_capacity"); ++i) pop.add_org( org_w, 0);
+    Experiment3 exp;
+    exp.set_population( pop);
+    exp.start( Generations_since_start( burn_in_gens), never);
+    burned= exp.population();
+  };
+  if( from_burned) burned_counts= Class_population( burned);
+  
+  if( prm.get_bool( "write_trajectory")) {
+    traj_file= new Trajectory_file( prm.get_string( "trajectory_filename"), prm.get_bool( "async_output") );
+    report_dt= prm.get_double( "report_dt");
+  };
+  
+  Trial_runner runner( prm.get_int("threads") );
+  runner.run( prm.get_int("trials"), trial, fixed);
+  delete traj_file;                                   // drains and stops the writer thread
+  
+  int numFix= 0;
+  for( unsigned int itrial= 0; itrial< fixed.size(); ++itrial)
+    if( fixed[ itrial] > 0) ++numFix;
    
-    //cout << "Pfix = "<< (double)numFix/prm.get_int("trials")<< endl;
-    cout<< (double)numFix/prm.get_int("trials")<< endl;
-return 0;
+  //cout << "Pfix = "<< (double)numFix/prm.get_int("trials")<< endl;
+  cout<< (double)numFix/prm.get_int("trials")<< endl;
+  double p_fix= (double)numFix/ fixed.size();               // binomial standard error, to judge
+  cerr<< "std_err= "<< sqrt( p_fix* ( 1- p_fix)/ fixed.size() )<< endl;   // approximate engines
+  return 0;
 
 }
\ No newline at end of file
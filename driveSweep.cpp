@@ -0,0 +1,247 @@
+// Parameter sweep of competition experiments (driveCompete.cpp) in one process.
+//
+// The sweep file (default sweep_compete.txt) names a base parameter file and lists the keys to
+// vary; every combination of their values is a parameter point.  Only the keys read per point
+// (population size, initial mutants, engine and the organism states) can be swept; sweeping any
+// other key aborts, and burn-in or trajectory settings in the base file are warned about and
+// ignored.  Each point's trials are split into blocks of trials_per_block, and the (point x
+// block) units are spread over the threads by Trial_runner, so all cores stay busy until the
+// whole sweep is done.  Each worker thread runs a unit with that point's organism states
+// (Organism::set_thread_states).  Trial i of point p uses random stream p * 2^32 + i of the
+// master seed, so results don't depend on the blocking or the number of threads.  One table with
+// the fixation probability of each point is written at the end.
+//
+// usage:  sweep.exe [sweep_file] [name=value ...]    (overrides the base parameter file)
+
+#include <ctime>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "paths.hpp"
+#include EXPERIMENT
+#include POPULATION
+#include CLASS_POPULATION
+#include ORGANISM
+#include RV_GENERATORS
+#include TEMP_TEMPLATES
+#include PARAMETERS
+#include TRIAL_RUNNER
+
+using namespace evolve;
+using namespace std;
+
+namespace {
+  // One parameter point, with the values its trials need looked up once
+  struct Sweep_point {
+    Parameters prm;
+    std::vector<std::string> values;                       // of the swept keys, for the table
+    std::vector<Org_state>   states;                       // Organism states for this point
+    int      pop_capacity;
+    int      cells_init_tracked;
+    Stepping stepping;
+    bool     counts_engine;
+    double   leap_eps;
+
+    explicit Sweep_point( const Parameters& p) : prm( p) {};
+  };
+
+  std::vector<std::string> keys;                           // swept parameter names
+  std::vector<Sweep_point> points;
+  unsigned long long seed;                                 // master seed
+  int trials;                                              // per point
+  int trials_per_block;
+  int blocks_per_point;
+
+  // Values of one "sweep <key> list|grid|log ..." line of the sweep file
+  std::vector<std::string> sweep_values( const std::string& key, std::istringstream& line) {
+    std::string kind;
+    line>> kind;
+    std::vector<std::string> vals;
+    if( kind == "list") {
+      std::string v;
+      while( line>> v) vals.push_back( v);
+    }
+    else if( kind == "grid" or kind == "log") {
+      double from, to;
+      int n;
+      if( not ( line>> from>> to>> n) or n< 1 or ( kind == "log" and ( from<= 0 or to<= 0) ) ) {
+        std::cout<< "Sweep file: "<< key<< " "<< kind<< " needs <from> <to> <n> with n >= 1"
+                 << ( kind == "log" ? " and positive bounds" : "")<< std::endl;
+        abort();
+      };
+      for( int i= 0; i< n; ++i) {
+        double f= ( n> 1) ? (double) i/ ( n- 1) : 0.0;
+        double v= ( kind == "grid") ? from+ f* ( to- from) : from* pow( to/ from, f);
+        std::string s;
+        string_format( s, v);
+        vals.push_back( s);
+      };
+    };
+    if( vals.empty() ) {
+      std::cout<< "Sweep file: expected list, grid or log values for "<< key<< " in '"<< line.str()
+               << "'"<< std::endl;
+      abort();
+    };
+    return vals;
+  };
+}
+
+// The parameters read per point, so the only ones a sweep may vary; all others are read once from
+// the base file (trials, seed, threads) or not at all (burn-in, trajectories, reports)
+std::vector<std::string> sweepable_names() {
+  const char* names[] = {"pop_capacity", "cells_init_tracked", "engine", "tau_leap_eps"};
+  std::vector<std::string> all( names, names+ sizeof( names)/ sizeof( names[ 0]) );
+  std::vector<Org_state> states;                           // so the switch names see 3 states
+  Organism::set_thread_states( &states);
+  Organism::add_states(3);
+  for( int st= 0; st< 3; ++st) {
+    std::vector<std::string> state_names= Organism::state_param_names( st);
+    std::vector<std::string> switch_names= Organism::switch_param_names( st);
+    all.insert( all.end(), state_names.begin(), state_names.end() );
+    all.insert( all.end(), switch_names.begin(), switch_names.end() );
+  };
+  Organism::set_thread_states( 0);
+  return all;
+};
+
+// Base-file settings of driveCompete that a sweep runs without
+void warn_unsupported( const Parameters& base) {
+  if( base.has( "burn_in_gens") and base.get_double( "burn_in_gens")> 0)
+    std::cerr<< "Warning: sweep.exe doesn't burn in; burn_in_gens is ignored."<< std::endl;
+  if( base.has( "burn_in_file") and base.get_string( "burn_in_file") != "none")
+    std::cerr<< "Warning: sweep.exe doesn't load populations; burn_in_file is ignored."<< std::endl;
+  if( base.has( "write_trajectory") and base.get_bool( "write_trajectory") )
+    std::cerr<< "Warning: sweep.exe writes no trajectories; write_trajectory is ignored."<< std::endl;
+};
+
+// One competition trial, as in driveCompete.cpp; returns 1 if the tracked organisms fixed
+template<class Pop>
+int sweep_trial( const Sweep_point& pt, const Rng& rng) {
+  Organism org_w;
+  Organism org_t;
+  org_t.set_tracked(1);
+
+  Pop pop;
+  pop.set_pop_capacity( pt.pop_capacity);
+  pop.set_rng( rng);
+  for( int i= 0; i< pt.pop_capacity- pt.cells_init_tracked; ++i) pop.add_org( org_w, 0);
+  for( int i= 0; i< pt.cells_init_tracked; ++i) pop.add_org( org_t, 1);
+
+  Basic_experiment<Pop> exp;
+  exp.set_population( std::move( pop) );
+  if( pt.stepping == tau_leaping)   exp.set_tau_leap( pt.leap_eps);
+  if( pt.stepping == wright_fisher) exp.set_wright_fisher();
+  if( pt.stepping == next_reaction) exp.set_next_reaction();
+  exp.start( fixed_or_lost, never);
+  return exp.population().num_wld_orgs() == 0;
+};
+
+// One scheduling unit: a block of one point's trials.  Returns the number that fixed.
+double sweep_unit( int unit) {
+  const int ipoint= unit/ blocks_per_point;
+  const int first= ( unit% blocks_per_point)* trials_per_block;
+  const int last= min( first+ trials_per_block, trials);
+  Sweep_point& pt= points[ ipoint];
+
+  Organism::set_thread_states( &pt.states);
+  int n_fixed= 0;
+  for( int itrial= first; itrial< last; ++itrial) {
+    Rng rng( seed, ( (unsigned long long) ipoint<< 32)+ itrial);
+    n_fixed+= pt.counts_engine ? sweep_trial<Class_population>( pt, rng)
+                               : sweep_trial<Population3>( pt, rng);
+  };
+  Organism::set_thread_states( 0);
+  return n_fixed;
+};
+
+int main( int argc, char** argv) {
+  std::string sweep_name= "sweep_compete.txt";
+  if( argc> 1 and std::string( argv[ 1]).find( '=') == std::string::npos) sweep_name= argv[ 1];
+  Parameters sweep_prm( sweep_name);
+  Parameters base( sweep_prm.get_string( "base_parameters") );
+  base.override_from( argc, argv);
+  trials_per_block= sweep_prm.get_int( "trials_per_block");
+  warn_unsupported( base);
+  const std::vector<std::string> sweepable= sweepable_names();
+
+  // Expand the sweep lines into points, the last line varying fastest
+  std::ifstream sweep_file( sweep_name.c_str() );
+  std::string text;
+  std::vector<std::vector<std::string> > values;
+  while( getline( sweep_file, text) ) {
+    std::istringstream line( text);
+    std::string word, key;
+    if( not ( line>> word) or word != "sweep") continue;
+    line>> key;
+    if( not base.has( key) ) {
+      std::cout<< "Sweep file: "<< key<< " is not in the base parameter file."<< std::endl;
+      abort();
+    };
+    if( find( sweepable.begin(), sweepable.end(), key) == sweepable.end() ) {
+      std::cout<< "Sweep file: "<< key<< " is read only from the base parameter file, "
+               << "so it can't be swept."<< std::endl;
+      abort();
+    };
+    keys.push_back( key);
+    values.push_back( sweep_values( key, line) );
+  };
+
+  int n_points= 1;
+  for( unsigned int k= 0; k< keys.size(); ++k) n_points*= values[ k].size();
+  for( int ipoint= 0; ipoint< n_points; ++ipoint) {
+    Sweep_point pt( base);
+    for( int k= keys.size()- 1, rest= ipoint; k>= 0; --k) {
+      pt.values.insert( pt.values.begin(), values[ k][ rest% values[ k].size()]);
+      pt.prm.set( keys[ k], pt.values.front() );
+      rest/= values[ k].size();
+    };
+    points.push_back( pt);
+  };
+
+  // Look up each point's settings once, making its organism states on this thread
+  for( int ipoint= 0; ipoint< n_points; ++ipoint) {
+    Sweep_point& pt= points[ ipoint];
+    Organism::set_thread_states( &pt.states);
+    Organism::add_states(3);
+    for( int st= 0; st< 3; ++st) Organism::set_state_params( st, pt.prm);
+
+    pt.pop_capacity=       pt.prm.get_int( "pop_capacity");
+    pt.cells_init_tracked= pt.prm.get_int( "cells_init_tracked");
+    std::string engine=    pt.prm.get_string( "engine");
+    pt.stepping=           engine_stepping( engine);       // aborts on unknown engines
+    pt.counts_engine=      counts_engine( engine);
+    pt.leap_eps=           pt.prm.get_double( "tau_leap_eps");
+  };
+  Organism::set_thread_states( 0);
+
+  seed= base.get_uint64( "seed");
+  if( seed == 0) seed= time( NULL)+ getpid();        // 0 means pick one, logged for reruns
+  trials= base.get_int( "trials");
+  blocks_per_point= ( trials+ trials_per_block- 1)/ trials_per_block;
+  std::cerr<< "seed= "<< seed<< "  points= "<< n_points<< "  units= "<< n_points* blocks_per_point
+           << std::endl;
+
+  std::vector<double> n_fixed;                                  // per unit
+  Trial_runner runner( base.get_int( "threads") );
+  runner.run( n_points* blocks_per_point, sweep_unit, n_fixed);
+
+  // One row per point: swept values, trials, fixation probability and its standard error
+  std::ofstream out( sweep_prm.get_string( "results_filename").c_str() );
+  for( unsigned int k= 0; k< keys.size(); ++k) out<< keys[ k]<< "\t";
+  out<< "trials\tp_fix\tstd_err\n";
+  for( int ipoint= 0; ipoint< n_points; ++ipoint) {
+    double fixed= 0;
+    for( int b= 0; b< blocks_per_point; ++b) fixed+= n_fixed[ ipoint* blocks_per_point+ b];
+    double p_fix= fixed/ trials;
+    for( unsigned int k= 0; k< keys.size(); ++k) out<< points[ ipoint].values[ k]<< "\t";
+    out<< trials<< "\t"<< p_fix<< "\t"<< sqrt( p_fix* ( 1- p_fix)/ trials)<< "\n";
+  };
+  return 0;
+};
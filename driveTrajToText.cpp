@@ -0,0 +1,32 @@
+// Converts a binary trajectory file (see trajectory.hpp) to tab-separated text, one line per
+// record, in Write_snapshot's column order preceded by the trial number:
+//
+//   trial  generations  time  mean_birth_rate  num_in_state...  num_trk_orgs  num_lineages
+//   mean_sq_birth_rate
+//
+// usage:  trajToText.exe trajectory_file > text_file
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "paths.hpp"
+#include TRAJECTORY
+
+using namespace evolve;
+
+int main( int argc, char** argv) {
+  if( argc != 2) {
+    std::cerr<< "usage: "<< argv[0]<< " trajectory_file"<< std::endl;
+    return 1;
+  };
+  
+  Trajectory_reader reader( argv[1]);
+  Trajectory_record rec;
+  while( reader.next( rec) ) {
+    printf( "%d\t%.10g\t%.10g\t%.10g\t", rec.trial, rec.generations, rec.time, rec.mean_birth_rate);
+    for( int st= 0; st< reader.num_states(); ++st) printf( "%d\t", rec.num_in_state[ st]);
+    printf( "%d\t%d\t%.10g\n", rec.num_trk_orgs, rec.num_lineages, rec.mean_sq_birth_rate);
+  };
+  return 0;
+};
@@ -0,0 +1,272 @@
+// Statistical validation of the population engines against analytic Moran results, to be run
+// before trusting a faster or approximate engine (counts, tau-leap, ...) in production.
+//
+// Fixation checks: pfix_trials competitions of pfix_init mutants against wild type in a Moran
+// population of pfix_pop, for neutral mutants and for mutants of relative fitness 1+ pfix_s.
+// Each engine's Pfix is compared with the exact Moran result (1- r^-i)/(1- r^-N), which also
+// holds for do_event()'s birth-then-death step, since the ratio of its down and up probabilities
+// is 1/r.  Wright-Fisher is left out of these: its fixation probabilities are not Moran's.
+//
+// Stationary checks: stat_replicates runs of a wild-type population of stat_pop with deleterious
+// mutation (per-birth probability u= 1- exp( -stat_mut_del)) of selection coefficient stat_s.
+// After stat_burn_gens generations the frequency of deleterious orgs, averaged over stat_gens
+// generations, is compared with the mutation-selection balance u/s.
+//
+// Every engine is also compared with every other engine on each check.  A check fails if its
+// estimate is more than z_crit standard errors from the expected value (for stationary checks,
+// plus stat_rel_tol relative tolerance for finite-N effects).  The exit status is the number of
+// failed checks.
+//
+// usage:  validate.exe [name=value ...]    (overrides parameters_validate.txt)
+
+#include <cmath>
+#include <ctime>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "paths.hpp"
+#include EXPERIMENT
+#include POPULATION
+#include CLASS_POPULATION
+#include ORGANISM
+#include RV_GENERATORS
+#include TEMP_TEMPLATES
+#include PARAMETERS
+#include TRIAL_RUNNER
+
+using namespace evolve;
+using namespace std;
+
+namespace {
+  Parameters prm;
+  unsigned long long seed;
+  double z_crit;
+  int n_checks= 0;
+  int n_failed= 0;
+  int n_runs= 0;                                           // each run gets its own random streams
+
+  // Settings of the check being run, read by the trial functions on every thread
+  std::string engine;
+  int pop_size;
+  int init_mutants;
+  double sel_coeff;                                        // stationary checks
+  double burn_gens;
+  double sample_gens;
+  unsigned long long stream_base;                          // trial i uses stream_base+ i
+
+  struct Estimate {
+    std::string engine;
+    double mean;
+    double std_err;
+    int    n;
+  };
+
+  std::vector<std::string> split( std::string list) {
+    std::vector<std::string> words;
+    std::istringstream in( list);
+    std::string word;
+    while( getline( in, word, ',') ) if( not word.empty() ) words.push_back( word);
+    return words;
+  };
+
+  // Three states with no switching or death; state 0 mutates, state 1 holds the competing mutants
+  void set_states( double mut_del, double s_del, double mutant_fitness) {
+    Parameters st_prm;
+    for( int st= 0; st< 3; ++st) {
+      std::vector<std::string> names= Organism::state_param_names( st);
+      const char* values[]= {"0", "0", "0", "0", "1", "-999", "0"};
+      for( int i= 0; i< 7; ++i) st_prm.set( names[ i], values[ i]);
+    };
+    std::string value;
+    string_format( value, mut_del);        st_prm.set( "mut_del_s0", value);
+    string_format( value, s_del);          st_prm.set( "s_del_s0", value);
+    string_format( value, mutant_fitness); st_prm.set( "birth_prefactor_s1", value);
+    for( int st= 0; st< 3; ++st) Organism::set_state_params( st, st_prm);
+  };
+
+  template<class Pop>
+  void set_stepping( Basic_experiment<Pop>& exp) {
+    const Stepping mode= engine_stepping( engine);
+    if( mode == tau_leaping)   exp.set_tau_leap( prm.get_double( "tau_leap_eps") );
+    if( mode == wright_fisher) exp.set_wright_fisher();
+    if( mode == next_reaction) exp.set_next_reaction();
+  };
+
+  bool individual_engine() {return not counts_engine( engine); };
+
+  // Accumulates the frequency of deleterious orgs, from the mean birth rate 1- s x
+  class Sample_deleterious {
+  public:
+    Sample_deleterious( double& sum, int& n) : sum( sum), n( n) {};
+    template<class Exp> void operator()( const Exp& exp) const {
+      if( exp.population().generations()< burn_gens) return;
+      const double mean_b= exp.population().birth_rate()/ exp.population().num_orgs();
+      sum+= ( 1- mean_b)/ sel_coeff;
+      ++n;
+    };
+  private:
+    double& sum;
+    int&    n;
+  };
+
+  template<class Pop>
+  double fixation_trial( int itrial) {
+    Organism org_w;
+    Organism org_t;
+    org_t.set_tracked(1);
+    Pop pop;
+    pop.set_pop_capacity( pop_size);
+    pop.set_rng( Rng( seed, stream_base+ itrial) );
+    for( int i= 0; i< pop_size- init_mutants; ++i) pop.add_org( org_w, 0);
+    for( int i= 0; i< init_mutants; ++i) pop.add_org( org_t, 1);
+
+    Basic_experiment<Pop> exp;
+    exp.set_population( pop);
+    set_stepping( exp);
+    exp.start( fixed_or_lost, never);
+    return exp.population().num_wld_orgs() == 0;
+  };
+
+  template<class Pop>
+  double stationary_trial( int itrial) {
+    Organism org_w;
+    Pop pop;
+    pop.set_pop_capacity( pop_size);
+    pop.set_rng( Rng( seed, stream_base+ itrial) );
+    for( int i= 0; i< pop_size; ++i) pop.add_org( org_w, 0);
+
+    double sum= 0;
+    int n= 0;
+    Basic_experiment<Pop> exp;
+    exp.set_population( pop);
+    set_stepping( exp);
+    exp.set_snapshot( Sample_deleterious( sum, n) );
+    exp.start( Generations_since_start( burn_gens+ sample_gens), Generations_since_last_snapshot( 1.0) );
+    return sum/ n;
+  };
+
+  double fixation_trial_fn( int itrial) {
+    return individual_engine() ? fixation_trial<Population3>( itrial)
+                               : fixation_trial<Class_population>( itrial);
+  };
+
+  double stationary_trial_fn( int itrial) {
+    return individual_engine() ? stationary_trial<Population3>( itrial)
+                               : stationary_trial<Class_population>( itrial);
+  };
+
+  // Runs the trials with the current settings, on a fresh set of random streams
+  Estimate run_trials( std::string eng, int n, Trial_fn trial, bool bernoulli) {
+    engine= eng;
+    stream_base= (unsigned long long) ++n_runs<< 32;
+    std::vector<double> results;
+    Trial_runner runner( prm.get_int( "threads") );
+    runner.run( n, trial, results);
+
+    Estimate est;
+    est.engine= eng;
+    est.n= n;
+    double sum= 0, sum_sq= 0;
+    for( int i= 0; i< n; ++i) {
+      sum+= results[ i];
+      sum_sq+= results[ i]* results[ i];
+    };
+    est.mean= sum/ n;
+    double var= bernoulli ? est.mean* ( 1- est.mean) : ( sum_sq- n* est.mean* est.mean)/ ( n- 1);
+    est.std_err= sqrt( max( var, 0.0)/ n);
+    return est;
+  };
+
+  void check( bool pass, std::string what) {
+    ++n_checks;
+    if( not pass) ++n_failed;
+    std::cout<< ( pass ? "PASS  " : "FAIL  ")<< what<< std::endl;
+  };
+
+  // Engine estimates against the expected value, then pairwise against each other
+  void judge( std::string name, const std::vector<Estimate>& ests, double expected,
+              double expected_se, double tolerance) {
+    for( unsigned int i= 0; i< ests.size(); ++i) {
+      const double se= ( expected_se > 0) ? expected_se : ests[ i].std_err;
+      const double z= ( ests[ i].mean- expected)/ se;
+      std::ostringstream what;
+      what<< name<< "  "<< ests[ i].engine<< ": "<< ests[ i].mean<< " +- "<< ests[ i].std_err
+          << "  expected "<< expected<< "  z= "<< z;
+      check( fabs( ests[ i].mean- expected) <= z_crit* se+ tolerance, what.str() );
+    };
+    for( unsigned int i= 0; i< ests.size(); ++i)
+      for( unsigned int j= i+ 1; j< ests.size(); ++j) {
+        const double se= sqrt( ests[ i].std_err* ests[ i].std_err+ ests[ j].std_err* ests[ j].std_err);
+        const double z= ( se > 0) ? ( ests[ i].mean- ests[ j].mean)/ se : 0.0;
+        std::ostringstream what;
+        what<< name<< "  "<< ests[ i].engine<< " vs "<< ests[ j].engine<< ": z= "<< z;
+        check( fabs( z) <= z_crit, what.str() );
+      };
+  };
+
+  // Moran fixation probability of i mutants of relative fitness r among N
+  double moran_pfix( double r, int i, int N) {
+    if( r == 1.0) return (double) i/ N;
+    return ( 1- pow( r, -i) )/ ( 1- pow( r, -N) );
+  };
+
+  void fixation_checks( double s) {
+    pop_size= prm.get_int( "pfix_pop");
+    init_mutants= prm.get_int( "pfix_init");
+    const int trials= prm.get_int( "pfix_trials");
+    const double p0= moran_pfix( 1+ s, init_mutants, pop_size);
+    set_states( 0, 0, 1+ s);
+
+    std::vector<std::string> engines= split( prm.get_string( "pfix_engines") );
+    std::vector<Estimate> ests;
+    for( unsigned int e= 0; e< engines.size(); ++e)
+      ests.push_back( run_trials( engines[ e], trials, fixation_trial_fn, true) );
+
+    std::ostringstream name;
+    name<< "pfix s= "<< s<< " N= "<< pop_size<< " i= "<< init_mutants;
+    judge( name.str(), ests, p0, sqrt( p0* ( 1- p0)/ trials), 0.0);
+  };
+
+  void stationary_checks() {
+    pop_size= prm.get_int( "stat_pop");
+    sel_coeff= prm.get_double( "stat_s");
+    burn_gens= prm.get_double( "stat_burn_gens");
+    sample_gens= prm.get_double( "stat_gens");
+    const double mut_del= prm.get_double( "stat_mut_del");
+    const double x0= ( 1- exp( -mut_del) )/ sel_coeff;
+    set_states( mut_del, sel_coeff, 1.0);
+
+    std::vector<std::string> engines= split( prm.get_string( "stat_engines") );
+    std::vector<Estimate> ests;
+    for( unsigned int e= 0; e< engines.size(); ++e)
+      ests.push_back( run_trials( engines[ e], prm.get_int( "stat_replicates"), stationary_trial_fn,
+                                  false) );
+
+    std::ostringstream name;
+    name<< "stationary u/s N= "<< pop_size;
+    judge( name.str(), ests, x0, 0.0, prm.get_double( "stat_rel_tol")* x0);
+  };
+}
+
+int main( int argc, char** argv) {
+  prm= Parameters( "parameters_validate.txt");
+  prm.override_from( argc, argv);
+  seed= prm.get_uint64( "seed");
+  if( seed == 0) seed= time( NULL)+ getpid();        // 0 means pick one, logged for reruns
+  std::cerr<< "seed= "<< seed<< std::endl;
+  z_crit= prm.get_double( "z_crit");
+  std::vector<std::string> engines= split( prm.get_string( "pfix_engines")+ ","+ prm.get_string( "stat_engines") );
+  for( unsigned int e= 0; e< engines.size(); ++e) engine_stepping( engines[ e]);   // typos abort now
+  Organism::add_states(3);
+
+  fixation_checks( 0.0);
+  fixation_checks( prm.get_double( "pfix_s") );
+  stationary_checks();
+
+  std::cout<< n_checks- n_failed<< " of "<< n_checks<< " checks passed"<< std::endl;
+  return n_failed;
+};
@@ -1,39 +1,66 @@
 #include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "paths.hpp"
 #include EXPERIMENT
+#include BINARY_ARCHIVE
 #include RV_GENERATORS
 
 using namespace std;
 namespace evolve{
 
-void Experiment::start() {
-  pre_snapshot(*this);                         // (function) value of pre_snapshot is set in driver
-  t_last_snapshot = t_elapsed;
-  g_last_snapshot= pop.generations();
-  /// ********************** main loop here  **************************//
-  while(not stop_cond(*this)) {
-  
-    pop.do_event();
-    if( pop.num_orgs()== 0) break;             // extinction occurred.  handle this case in driver
-    
-    t_elapsed += rnd_expo(pop.event_rate() );
-    
-    if (snapshot_cond(*this)) {
-      snapshot(*this);
-      t_last_snapshot = t_elapsed;
-      g_last_snapshot= pop.generations();
-      pop.update_birth_ub();                  // there's probably a better place to put this, but...
-    }; 
+namespace {
+// Approximate steps, for the counts engine only.  Return the time advanced
+double approx_step(Class_population& pop, Stepping mode, double eps) {
+  if (mode == tau_leaping) return pop.leap(eps);
+  if (mode == next_reaction) {
+    std::cout << "The next-reaction method needs the individual engine (Population)." << std::endl;
+    abort();
   };
-  /// ******************************************************************//
-  post_snapshot(*this);
-  t_last_snapshot = t_elapsed;
-  g_last_snapshot= pop.generations();
+  assert(mode == wright_fisher);
+  return pop.wf_generation();
+};
+
+template<int N>
+double approx_step(Basic_population<N>& pop, Stepping mode, double) {
+  if (mode == next_reaction) return pop.next_reaction_step();
+  std::cout << "Tau-leaping and Wright-Fisher steps need the counts engine (Class_population)." 
+            << std::endl;
+  abort();
+};
+}
+
+Stepping engine_stepping(std::string engine) {
+  if (engine == "individual" or engine == "counts") return exact_events;
+  if (engine == "next_reaction")                    return next_reaction;
+  if (engine == "tau_leap")                         return tau_leaping;
+  if (engine == "wright_fisher")                    return wright_fisher;
+  std::cout << "Unknown engine '" << engine << "': expected individual, next_reaction, counts, "
+            << "tau_leap or wright_fisher." << std::endl;
+  abort();
+};
+
+bool counts_engine(std::string engine) {
+  const Stepping mode = engine_stepping(engine);
+  return engine == "counts" or mode == tau_leaping or mode == wright_fisher;
 };
 
-void Write_snapshot::operator()(const Experiment& exp){
-  const Population& p = exp.population();
+template<class Pop>
+void Basic_experiment<Pop>::start() {start(stop_cond, snapshot_cond); };
+
+template<class Pop>
+double Basic_experiment<Pop>::approx_step() {return evolve::approx_step(pop, stepping, leap_eps); };
+
+template<class Exp>
+void Write_snapshot::operator()(const Exp& exp){
+  const typename Exp::Population_type& p = exp.population();
   
   //std::cout<<"meanfit = "<< p.tot_ones()/p.num_orgs()<<std::endl;
   o_file<< p.generations()    << "\t" << 
@@ -49,87 +76,266 @@ void Write_snapshot::operator()(const Experiment& exp){
            p.sum_squared_birth_rate()/ p.num_orgs()<< "\t"<< std::endl;
 };
 
-void load_pop(Population& pop, std::string filename) {
-  std::ifstream file(filename.c_str());  
-  boost::archive::text_iarchive arch(file);
+template<class Exp>
+void Write_trajectory::operator()(const Exp& exp){
+  const typename Exp::Population_type& p = exp.population();
+  
+  rec.generations     = p.generations();
+  rec.time            = exp.time_elapsed();
+  rec.mean_birth_rate = p.birth_rate()/p.num_orgs();
+  rec.num_in_state.resize(Organism::num_states());
+  for (int i = 0; i < Organism::num_states(); ++i)
+    rec.num_in_state[i] = p.num_in_state(i);
+  rec.num_trk_orgs       = p.num_trk_orgs();
+  rec.num_lineages       = p.num_lineages();
+  rec.mean_sq_birth_rate = p.sum_squared_birth_rate()/ p.num_orgs();
+  traj.append(rec);
+};
+
+// Binary population files start with this magic and a format version, followed by the population
+// in Binary_oarchive form: states once, the lineage pool, the orgs' lineage ids, rate bookkeeping
+// and the random generator.  Older text archives are not read.  Experiment checkpoints have
+// their own magic, and hold the experiment's time and snapshot bookkeeping before the population.
+namespace {
+const char     pop_magic[8]     = {'E','V','P','O','P','B','I','N'};
+const unsigned pop_bin_version  = 7;            // 2: state trees, 3: next-reaction times, 4: switching tables,
+                                                // 5: orgs by genotype, 6: no birth-rate classes,
+                                                // 7: no per-lineage birth rates
+const char     ckpt_magic[8]    = {'E','V','E','X','P','C','K','P'};
+const unsigned ckpt_version     = 7;
+
+// A whole file mapped read-only, unmapped when this goes out of scope
+class Mapped_file {
+public:
+  explicit Mapped_file(std::string filename) : data(0), size(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0) return;
+    if (fstat(fd, &info) == 0 and info.st_size > 0) {
+      void* map = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED) {
+        data = static_cast<const char*>(map);
+        size = info.st_size;
+      };
+    };
+    close(fd);
+  };
+  ~Mapped_file() {if (data) munmap(const_cast<char*>(data), size); };
+
+  bool starts_with(const char magic[8]) const {
+    return size >= 8 and memcmp(data, magic, 8) == 0;
+  };
+  const char* data;
+  size_t      size;
+private:
+  Mapped_file(const Mapped_file&);
+  Mapped_file& operator=(const Mapped_file&);
+};
+
+void check_version(unsigned version, unsigned expected, std::string filename) {
+  if (version != expected) {
+    std::cout << filename << " has unknown format version " << version << std::endl;
+    abort();
+  };
+};
+
+// One write of the archive's buffer.  Written under a temporary name and then renamed, so a job
+// killed while writing leaves the previous file intact.
+void write_archive(const Binary_oarchive& arch, std::string filename) {
+  std::string tmp_name = filename + ".tmp";
+  {
+    std::ofstream out_file(tmp_name.c_str(), std::ios::binary);    
+    out_file.write(&arch.buffer()[0], arch.buffer().size());
+    if (not out_file) {
+      std::cout << "can't write " << tmp_name << std::endl;
+      abort();
+    };
+  }
+  rename(tmp_name.c_str(), filename.c_str());
+};
+}
+
+template<int N>
+void load_pop(Basic_population<N>& pop, std::string filename) {
+  Mapped_file file(filename);
+  if (not file.data) {
+    std::cout << "load_pop: can't open " << filename << std::endl;
+    abort();
+  };
+  if (not file.starts_with(pop_magic)) {      // e.g. a boost text archive of older versions
+    std::cout << "load_pop: " << filename << " is in an unsupported pre-binary format; "
+              << "re-create it with this version's save_pop()." << std::endl;
+    abort();
+  };
+  Binary_iarchive arch(file.data + sizeof(pop_magic), file.data + file.size);
+  unsigned version;
+  arch >> version;
+  check_version(version, pop_bin_version, filename);
   arch >> pop;
   pop.reset_counts();
 };
 
-void save_pop(const Population& pop, std::string filename) {
-  // Open output file and archive the population
-  std::ofstream out_file(filename.c_str());    
-  boost::archive::text_oarchive out_archive(out_file);    
-  out_archive << as_const(pop);  
+template<int N>
+void save_pop(const Basic_population<N>& pop, std::string filename) {
+  // Archive the population into memory, then write it out at once
+  Binary_oarchive arch;
+  arch.save_bytes(pop_magic, sizeof(pop_magic));
+  arch << pop_bin_version << pop;
+  write_archive(arch, filename);
 };
 
 
-const  Population& Experiment::population()    const {return pop;                       };
-double Experiment::time_last_snapshot()        const {return t_last_snapshot;            };
-double Experiment::generations_last_snapshot() const {return g_last_snapshot;            };
-double Experiment::time_elapsed()              const {return t_elapsed;                  };
-double Experiment::generations_elapsed()       const {return population().generations(); };
+template<class Pop> const Pop& Basic_experiment<Pop>::population() const {return pop;             };
+template<class Pop> double Basic_experiment<Pop>::time_last_snapshot()  const {return t_last_snapshot; };
+template<class Pop> double Basic_experiment<Pop>::generations_last_snapshot() const {
+  return g_last_snapshot;
+};
+template<class Pop> double Basic_experiment<Pop>::time_elapsed()        const {return t_elapsed;       };
+template<class Pop> double Basic_experiment<Pop>::generations_elapsed() const {
+  return population().generations();
+};
 
 
-Experiment& Experiment::set_population(const Population& p) {
+template<class Pop>
+Basic_experiment<Pop>& Basic_experiment<Pop>::set_population(const Pop& p) {
   pop = p;
   return *this;
 };
 
+template<class Pop>
+Basic_experiment<Pop>& Basic_experiment<Pop>::set_population(Pop&& p) {
+  pop = std::move(p);
+  return *this;
+};
 
-Experiment& Experiment::set_stop_cond(Exp_cond cond){
+
+template<class Pop>
+Basic_experiment<Pop>& Basic_experiment<Pop>::set_stop_cond(Cond_fn cond){
   stop_cond = cond;
   return *this;
 };
   
-Experiment& Experiment::set_snapshot_cond(Exp_cond cond)  {
+template<class Pop>
+Basic_experiment<Pop>& Basic_experiment<Pop>::set_snapshot_cond(Cond_fn cond)  {
   snapshot_cond = cond;
   return *this;
 };
 
-Experiment& Experiment::set_pre_snapshot(Exp_snap snap)  {
+template<class Pop>
+Basic_experiment<Pop>& Basic_experiment<Pop>::set_pre_snapshot(Snap_fn snap)  {
   pre_snapshot = snap;
   return *this;
 };
 
-Experiment& Experiment::set_snapshot(Exp_snap snap) {
+template<class Pop>
+Basic_experiment<Pop>& Basic_experiment<Pop>::set_snapshot(Snap_fn snap) {
   snapshot = snap;
   return *this;
 };
 
-Experiment& Experiment::set_post_snapshot(Exp_snap snap) {
+template<class Pop>
+Basic_experiment<Pop>& Basic_experiment<Pop>::set_post_snapshot(Snap_fn snap) {
   post_snapshot = snap;
   return *this;
 };
 
-Experiment::Experiment() 
+template<class Pop>
+Basic_experiment<Pop>& Basic_experiment<Pop>::set_tau_leap(double eps) {
+  assert(eps >= 0.0);
+  leap_eps = eps;
+  stepping = (eps > 0.0) ? tau_leaping : exact_events;
+  return *this;
+};
+
+template<class Pop>
+Basic_experiment<Pop>& Basic_experiment<Pop>::set_wright_fisher() {
+  stepping = wright_fisher;
+  return *this;
+};
+
+template<class Pop>
+Basic_experiment<Pop>& Basic_experiment<Pop>::set_next_reaction() {
+  stepping = next_reaction;
+  return *this;
+};
+
+template<class Pop>
+Basic_experiment<Pop>& Basic_experiment<Pop>::set_checkpoint(std::string file, double gen_interval, 
+                                                             double wall_secs) {
+  assert(gen_interval >= 0.0);
+  assert(wall_secs >= 0.0);
+  ckpt_file = file;
+  ckpt_gens = gen_interval;
+  ckpt_secs = wall_secs;
+  return *this;
+};
+
+template<class Pop>
+void Basic_experiment<Pop>::schedule_checkpoint() {
+  g_next_ckpt = pop.generations() + ckpt_gens;
+  t_next_ckpt = time(NULL) + (time_t) ckpt_secs;
+  ckpt_polls  = 0;
+};
+
+template<class Pop>
+void Basic_experiment<Pop>::save_checkpoint(std::string file) const {
+  Binary_oarchive arch;
+  arch.save_bytes(ckpt_magic, sizeof(ckpt_magic));
+  arch << ckpt_version << t_elapsed << t_last_snapshot << g_last_snapshot 
+       << (int) stepping << leap_eps << pop;
+  write_archive(arch, file);
+};
+
+template<class Pop>
+bool Basic_experiment<Pop>::resume(std::string file) {
+  Mapped_file in_file(file);
+  if (not in_file.starts_with(ckpt_magic)) return false;
+  
+  Binary_iarchive arch(in_file.data + sizeof(ckpt_magic), in_file.data + in_file.size);
+  unsigned version;
+  int step_mode;
+  arch >> version;
+  check_version(version, ckpt_version, file);
+  arch >> t_elapsed >> t_last_snapshot >> g_last_snapshot >> step_mode >> leap_eps >> pop;
+  stepping = (Stepping) step_mode;
+  resumed = true;
+  return true;
+};
+
+template<class Pop>
+Basic_experiment<Pop>::Basic_experiment() 
   : t_elapsed(0.0),
     t_last_snapshot(-1.0),     // Indicates no snapshot taken yet
     g_last_snapshot(-1.0),
+    stepping(exact_events),
+    leap_eps(0.0),
     pre_snapshot(nothing),
     snapshot(nothing),
     post_snapshot(nothing),
     snapshot_cond(never),
-    stop_cond(always) {};
-
-// *********   Boolean tests for experimental conditions.  Namespace scope   *********
-bool fixed(const Experiment& exp) {
-  return (exp.population().num_trk_orgs() == exp.population().num_orgs());
-};	  
-bool lost(const Experiment& exp) {
-  return (exp.population().num_trk_orgs() == 0);
-};	  
-bool fixed_or_lost(const Experiment& exp) {return (lost(exp) or fixed(exp)); };
-bool never(const Experiment& exp)         {return false; };
-bool always(const Experiment& exp)        {return true;  };
-void nothing(const Experiment& exp)       {};
-void test(const Experiment& exp) {
-  std::cout << "time_elapsed = " << exp.time_elapsed() 
-       << "  num_lineages = " << exp.population().num_lineages() << std::endl;
-};
-
+    stop_cond(always),
+    resumed(false),
+    ckpt_gens(0.0),
+    ckpt_secs(0.0),
+    g_next_ckpt(0.0),
+    t_next_ckpt(0),
+    ckpt_polls(0) {};
 
+// ***********   Population engines an experiment can be run with   ***********
+template class Basic_experiment<Population>;
+template class Basic_experiment<Population3>;
+template class Basic_experiment<Class_population>;
 
+template void load_pop(Population&, std::string);
+template void load_pop(Population3&, std::string);
+template void save_pop(const Population&, std::string);
+template void save_pop(const Population3&, std::string);
 
+template void Write_snapshot::operator()(const Experiment&);
+template void Write_snapshot::operator()(const Experiment3&);
+template void Write_snapshot::operator()(const Class_experiment&);
+template void Write_trajectory::operator()(const Experiment&);
+template void Write_trajectory::operator()(const Experiment3&);
+template void Write_trajectory::operator()(const Class_experiment&);
 
 }
@@ -6,41 +6,73 @@
 //
 // The condition functions, e.g. Time_since_start(double) are actually classes, whose data members
 // can be interpreted as the function's argument.  
+//
+// start(stop, snapshot_cond) takes the two conditions as template arguments instead, so that
+// checks made after every event, e.g. start(fixed_or_lost, never), are inlined into the main loop.
+// start() is this loop run with the boost::function conditions, and works with any of them.
+//
+// set_checkpoint() makes start() save the whole experiment (population with its random generator,
+// time, snapshot bookkeeping) every so many generations and/or seconds of wall-clock time.  After
+// resume() from such a file, start() continues the trajectory exactly where it was saved.
+//
+// Built with -DEVOLVE_INSTRUMENT, start() ends by reporting the hot-path counters of its run
+// (instrument.hpp) on std::cerr.
+//
+// set_next_reaction() makes start() advance a Population with Population::next_reaction_step()
+// instead of do_event(): the same process, simulated by Gibson and Bruck's next-reaction method.
+//
+// Experiment is Basic_experiment<Population>.  Basic_experiment works with any population engine
+// offering Population's interface for dynamics and observables, e.g. Class_experiment evolves a
+// count-based Class_population, and Experiment3 the 3-state Population3.  The conditions below
+// are function objects that accept any of them.
 
 
 #ifndef _EXPERIMENT_
 #define _EXPERIMENT_
 
 #include <iostream>
+#include <ctime>
+#include <string>
 #include <boost/function.hpp>
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
 
 #include "paths.hpp"
 #include POPULATION
+#include CLASS_POPULATION
+#include TRAJECTORY
+#include INSTRUMENT
 
 using namespace std;
 
 namespace evolve {
 
-class Experiment;                                             // class defined below
+template<class Pop> class Basic_experiment;                   // class defined below
+enum Stepping {exact_events, tau_leaping, wright_fisher,      // how start() advances the population
+               next_reaction};
+
+// Engines a driver's "engine" parameter may name: individual and next_reaction step a Population,
+// counts, tau_leap and wright_fisher a Class_population.  Both abort on any other name.
+Stepping engine_stepping(std::string engine);
+bool     counts_engine(std::string engine);
 
-// namespace scope functions for (de)archiving populaitons with boost:: library
-void load_pop(Population&, std::string);
-void save_pop(const Population&, std::string);
+typedef Basic_experiment<Population>       Experiment;
+typedef Basic_experiment<Population3>      Experiment3;
+typedef Basic_experiment<Class_population> Class_experiment;
+
+// namespace scope functions for (de)archiving populations.  save_pop writes a compact binary
+// snapshot (see experiment.cpp); load_pop reads it, and aborts on the text archives of older versions.
+template<int NStates> void load_pop(Basic_population<NStates>&, std::string);
+template<int NStates> void save_pop(const Basic_population<NStates>&, std::string);
 
 // function place holders: will be associated with, e.g. fixed_or_lost
 typedef boost::function<void (const Experiment&)> Exp_snap;   // how to record data
 typedef boost::function<bool (const Experiment&)> Exp_cond;   // when to record data, start, quit
 
-// namespace scope functions.  Will be assigned to Exp_cond
-void test         (const Experiment&);
-bool fixed        (const Experiment&);
-bool lost         (const Experiment&);
-bool fixed_or_lost(const Experiment&); 
-bool never        (const Experiment&);       
-bool always       (const Experiment&);      
-void nothing      (const Experiment&);    
+// Namespace scope "functions", assigned to Exp_cond/Exp_snap.  Each is an object of the class
+// below, so that one name works for every kind of Basic_experiment.
+class Test;            class Fixed;     class Lost;      class Fixed_or_lost;
+class Never;           class Always;    class Nothing;
 
 // Will be assigned to Exp_cond, just as functions above, e.g. fixed_or_lost.  The only
 // purpose of these "classes" is to define a function that holds a value.
@@ -49,56 +81,159 @@ class Time_since_start;
 class Time_since_last_snapshot;
 
 class Write_snapshot; 					// Important: this specifies which data is written down
+class Write_trajectory;                                 // same data, as binary records
+class Sync_trajectory;                                  // e.g. post_snapshot: records all written
 
 // ****************************************************************************
 // ***********************          Experiment          ***********************
 // ****************************************************************************
 
-class Experiment {
+template<class Pop>
+class Basic_experiment {
 public:
-  Experiment();
-  void start();
+  typedef Pop Population_type;
+  typedef boost::function<void (const Basic_experiment&)> Snap_fn;
+  typedef boost::function<bool (const Basic_experiment&)> Cond_fn;
+
+  Basic_experiment();
+  void start();                                // uses the conditions set below
+  template<class Stop, class Snap_cond>
+  void start(const Stop&, const Snap_cond&);   // conditions known at compile time
 
-  Experiment& set_population( const Population&);
-  Experiment& set_stop_cond    ( Exp_cond);
-  Experiment& set_snapshot_cond( Exp_cond);
-  Experiment& set_pre_snapshot ( Exp_snap);
-  Experiment& set_snapshot     ( Exp_snap);
-  Experiment& set_post_snapshot( Exp_snap);
+  Basic_experiment& set_population( const Pop&);
+  Basic_experiment& set_population( Pop&&);          // takes over the population, no copy
+  Basic_experiment& set_stop_cond    ( Cond_fn);
+  Basic_experiment& set_snapshot_cond( Cond_fn);
+  Basic_experiment& set_pre_snapshot ( Snap_fn);
+  Basic_experiment& set_snapshot     ( Snap_fn);
+  Basic_experiment& set_post_snapshot( Snap_fn);
+  Basic_experiment& set_tau_leap     ( double eps);  // 0 = exact events; needs Class_population
+  Basic_experiment& set_wright_fisher();              // generation steps; needs Class_population
+  Basic_experiment& set_next_reaction();              // next-reaction method; needs Population
+  Basic_experiment& set_checkpoint( std::string file, double gen_interval, double wall_secs= 0);
+  bool resume( std::string file);                     // false if there's no checkpoint to resume
+  void save_checkpoint( std::string file) const;
   
-  const  Population& population()    const;
+  const  Pop& population()           const;
   double time_elapsed()              const; 
   double generations_elapsed()       const;
   double time_last_snapshot()        const; 
   double generations_last_snapshot() const;
 private:
-  Population  pop;
+  Pop    pop;
   double t_elapsed;
   double t_last_snapshot;
   double g_last_snapshot;
+  Stepping stepping;
+  double leap_eps;                  // tau-leaping accuracy
   
-  Exp_snap pre_snapshot;
-  Exp_snap snapshot;
-  Exp_snap post_snapshot;
-  Exp_cond snapshot_cond;
-  Exp_cond stop_cond;
+  Snap_fn pre_snapshot;
+  Snap_fn snapshot;
+  Snap_fn post_snapshot;
+  Cond_fn snapshot_cond;
+  Cond_fn stop_cond;
+
+  bool   resumed;                   // start() skips pre_snapshot when continuing a checkpoint
+  std::string ckpt_file;            // empty = no checkpoints
+  double ckpt_gens;                 // generations between checkpoints, 0 = not by generations
+  double ckpt_secs;                 // wall-clock seconds between checkpoints, 0 = not by time
+  double g_next_ckpt;
+  time_t t_next_ckpt;
+  int    ckpt_polls;                // wall clock is only read every 1024 steps
+
+  double approx_step();             // tau-leap, Wright-Fisher or next-reaction step, returns time
+  void   mark_snapshot();           // records time and generations of a snapshot
+  bool   checkpoint_due();
+  void   schedule_checkpoint();
+};
+
+template<class Pop> template<class Stop, class Snap_cond>
+void Basic_experiment<Pop>::start(const Stop& stop, const Snap_cond& take_snapshot) {
+#ifdef EVOLVE_INSTRUMENT
+  const Instr_counters instr_at_start = instr_counters();
+#endif
+  if (not resumed) {
+    pre_snapshot(*this);                       // (function) value of pre_snapshot is set in driver
+    mark_snapshot();
+  };
+  resumed = false;
+  schedule_checkpoint();
+  /// ********************** main loop here  **************************//
+  while(not stop(*this)) {
+  
+    if (stepping != exact_events) {
+      double dt = approx_step();
+      if( pop.num_orgs()== 0) break;
+      t_elapsed += dt;
+    }
+    else {
+      pop.do_event();
+      if( pop.num_orgs()== 0) break;           // extinction occurred.  handle this case in driver
+    
+      t_elapsed += rnd_expo(pop.rng(), pop.event_rate() );
+    };
+    
+    if (take_snapshot(*this)) {
+      snapshot(*this);
+      mark_snapshot();
+    }; 
+    
+    if (not ckpt_file.empty() and checkpoint_due()) {
+      save_checkpoint(ckpt_file);
+      schedule_checkpoint();
+    };
+  };
+  /// ******************************************************************//
+  post_snapshot(*this);
+  mark_snapshot();
+#ifdef EVOLVE_INSTRUMENT
+  std::cerr << instr_counters() - instr_at_start;      // what this run cost, see instrument.hpp
+#endif
+};
+
+template<class Pop> inline bool Basic_experiment<Pop>::checkpoint_due() {
+  if (ckpt_gens > 0 and pop.generations() >= g_next_ckpt) return true;
+  return ckpt_secs > 0 and (++ckpt_polls & 1023) == 0 and time(NULL) >= t_next_ckpt;
+};
+
+template<class Pop> inline void Basic_experiment<Pop>::mark_snapshot() {
+  t_last_snapshot = t_elapsed;
+  g_last_snapshot = pop.generations();
 };
 
 // really this is a function that holds a file, more than a "class"
 class Write_snapshot {
 public:
   Write_snapshot(std::ofstream& out_file) : o_file(out_file) {};
-  void operator()(const Experiment&);
+  template<class Exp> void operator()(const Exp&);
 private:
   std::ofstream& o_file;
 };
 
+// Same columns as Write_snapshot, as one binary record in a trial's Trajectory_writer
+class Write_trajectory {
+public:
+  Write_trajectory(Trajectory_writer& writer) : traj(writer) {};
+  template<class Exp> void operator()(const Exp&);
+private:
+  Trajectory_writer& traj;
+  Trajectory_record  rec;
+};
+
+class Sync_trajectory {
+public:
+  Sync_trajectory(Trajectory_writer& writer) : traj(writer) {};
+  template<class Exp> void operator()(const Exp&) {traj.sync(); };
+private:
+  Trajectory_writer& traj;
+};
+
 
 class Mean_fit_at_least {
 public:
   explicit Mean_fit_at_least(double fit) : mean_fit(fit) {assert(fit >= 0.0);};
   
-  bool operator()(const Experiment& exp) const {
+  template<class Exp> bool operator()(const Exp& exp) const {
     return ((exp.population().birth_rate() / exp.population().num_orgs())
 	    > mean_fit);
   };
@@ -110,7 +245,7 @@ private:
 class Time_since_start {
 public:
   explicit Time_since_start(double t) : time(t) {assert(time >= 0.0); };
-  bool operator()(const Experiment& exp) const {
+  template<class Exp> bool operator()(const Exp& exp) const {
     return exp.time_elapsed() > time; 
   };
 private:
@@ -120,7 +255,7 @@ private:
 class Generations_since_start {
 public:
   explicit Generations_since_start( double t) : gens( t) {assert( gens>= 0.0);};
-  bool operator()( const Experiment& exp) const{
+  template<class Exp> bool operator()( const Exp& exp) const{
     return exp.population().generations()> gens;
   };
 private:
@@ -132,7 +267,7 @@ public:
   explicit Time_since_last_snapshot(double time_interval) 
     : t_interval(time_interval) { assert(time_interval > 0.0); };
   
-  bool operator()(const Experiment& exp) {
+  template<class Exp> bool operator()(const Exp& exp) const {
     return exp.time_elapsed() > (exp.time_last_snapshot() + t_interval);
   };
 private:
@@ -144,7 +279,7 @@ public:
   explicit Generations_since_last_snapshot( double gen_interval)
     : g_interval( gen_interval) { assert( gen_interval> 0.0 ); };
     
-  bool operator()( const Experiment& exp){
+  template<class Exp> bool operator()( const Exp& exp) const {
     return exp.population().generations()> (exp.generations_last_snapshot()+ g_interval);
   };
 private:
@@ -152,6 +287,59 @@ private:
 };
 
 
+// *********   Boolean tests for experimental conditions.  Namespace scope   *********
+class Fixed {
+public:
+  template<class Exp> bool operator()(const Exp& exp) const {
+    return (exp.population().num_trk_orgs() == exp.population().num_orgs());
+  };
+};
+
+class Lost {
+public:
+  template<class Exp> bool operator()(const Exp& exp) const {
+    return (exp.population().num_trk_orgs() == 0);
+  };
+};
+
+class Fixed_or_lost {
+public:
+  template<class Exp> bool operator()(const Exp& exp) const {
+    return (Lost()(exp) or Fixed()(exp));
+  };
+};
+
+class Never {
+public:
+  template<class Exp> bool operator()(const Exp&) const {return false; };
+};
+
+class Always {
+public:
+  template<class Exp> bool operator()(const Exp&) const {return true;  };
+};
+
+class Nothing {
+public:
+  template<class Exp> void operator()(const Exp&) const {};
+};
+
+class Test {
+public:
+  template<class Exp> void operator()(const Exp& exp) const {
+    std::cout << "time_elapsed = " << exp.time_elapsed() 
+         << "  num_lineages = " << exp.population().num_lineages() << std::endl;
+  };
+};
+
+const Test          test          = Test();
+const Fixed         fixed         = Fixed();
+const Lost          lost          = Lost();
+const Fixed_or_lost fixed_or_lost = Fixed_or_lost();
+const Never         never         = Never();
+const Always        always        = Always();
+const Nothing       nothing       = Nothing();
+
 }  // end namespace block
 
 #endif
@@ -0,0 +1,83 @@
+//  Indexed_heap is a binary min-heap of the keys of a fixed set of items 0..n-1, e.g. the putative
+//  firing times of a population's reaction channels in the next-reaction method
+//  (Population::next_reaction_step()).  Each item's position in the heap is tracked, so the key of
+//  any item can be changed in O(log n), and the item with the smallest key is found in O(1).
+
+
+#ifndef _INDEXED_HEAP_
+#define _INDEXED_HEAP_
+
+#include <assert.h>
+#include <vector>
+#include <boost/serialization/vector.hpp>
+
+namespace evolve{
+
+class Indexed_heap {
+public:
+  void   assign(int n, double key);         // n items, all with this key
+  int    size()         const {return keys.size(); };
+  int    top()          const {assert(size() > 0); return heap[0]; };   // item with smallest key
+  double key(int item)  const {return keys[item]; };
+  void   set(int item, double key);
+private:
+  std::vector<double> keys;                 // by item
+  std::vector<int>    heap;                 // items in heap order
+  std::vector<int>    pos;                  // position of each item in heap
+
+  void place(int item, int p) {heap[p] = item; pos[item] = p; };
+  void sift_up(int p);
+  void sift_down(int p);
+
+  // Enable reading/writing of object to archive file
+  friend class boost::serialization::access;
+  template<class Archive>
+  void serialize(Archive & ar, const unsigned int version) {
+    ar & keys;
+    ar & heap;
+    ar & pos;
+  };
+};
+
+inline void Indexed_heap::assign(int n, double key) {
+  keys.assign(n, key);
+  heap.resize(n);
+  pos.resize(n);
+  for (int i = 0; i < n; ++i) place(i, i);
+};
+
+inline void Indexed_heap::set(int item, double key) {
+  assert(item >= 0);
+  assert(item < size());
+  const double old = keys[item];
+  keys[item] = key;
+  if (key < old) sift_up(pos[item]);
+  else           sift_down(pos[item]);
+};
+
+inline void Indexed_heap::sift_up(int p) {
+  const int item = heap[p];
+  while (p > 0 and keys[heap[(p - 1) / 2]] > keys[item]) {
+    place(heap[(p - 1) / 2], p);
+    p = (p - 1) / 2;
+  };
+  place(item, p);
+};
+
+inline void Indexed_heap::sift_down(int p) {
+  const int item = heap[p];
+  const int n = size();
+  for (;;) {
+    int child = 2 * p + 1;
+    if (child >= n) break;
+    if (child + 1 < n and keys[heap[child + 1]] < keys[heap[child]]) ++child;
+    if (keys[heap[child]] >= keys[item]) break;
+    place(heap[child], p);
+    p = child;
+  };
+  place(item, p);
+};
+
+} // end namespace block
+
+#endif
@@ -0,0 +1,138 @@
+//  Hot-path instrumentation of Population, compiled out unless EVOLVE_INSTRUMENT is defined.
+//
+//  With -DEVOLVE_INSTRUMENT, each thread keeps an Instr_counters of what the event functions
+//  actually do: events, births and parent draws per birth, deaths, state changes, lineages created
+//  and released, and pushes and pops of the trk_lines/wld_lines lists.  Adding
+//  -DEVOLVE_INSTRUMENT_TSC also times do_event, birth, death and state_changer with the time stamp
+//  counter (cycles; nanoseconds of steady_clock on other processors).  Basic_experiment::start()
+//  reports what its own run added to the calling thread's counters on std::cerr.
+//
+//  Without the flag INSTR_COUNT and INSTR_TIME expand to nothing, so the default build is
+//  unchanged.  The flag must be the same for every object file (see INSTRUMENT in the Makefile).
+
+
+#ifndef _INSTRUMENT_
+#define _INSTRUMENT_
+
+#include <iostream>
+
+#if defined(EVOLVE_INSTRUMENT_TSC) && !defined(EVOLVE_INSTRUMENT)
+#define EVOLVE_INSTRUMENT                        // timers come with the counters
+#endif
+
+#ifdef EVOLVE_INSTRUMENT_TSC
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+#endif
+
+namespace evolve {
+
+struct Instr_counters {
+  unsigned long long events;               // do_event() calls
+  unsigned long long births;
+  unsigned long long birth_draws;          // parent draws in birth(), > births only via round-off
+  unsigned long long deaths;
+  unsigned long long state_chgs;
+  unsigned long long lineages_created;
+  unsigned long long lineages_released;
+  unsigned long long line_list_pushes;     // lineages added to trk_lines/wld_lines
+  unsigned long long line_list_pops;
+
+  unsigned long long event_cycles;         // with EVOLVE_INSTRUMENT_TSC only
+  unsigned long long birth_cycles;
+  unsigned long long death_cycles;
+  unsigned long long state_chg_cycles;
+
+  Instr_counters() : events(0), births(0), birth_draws(0), deaths(0), state_chgs(0),
+    lineages_created(0), lineages_released(0), line_list_pushes(0), line_list_pops(0),
+    event_cycles(0), birth_cycles(0), death_cycles(0), state_chg_cycles(0) {};
+  void clear() {*this = Instr_counters(); };
+  Instr_counters operator-(const Instr_counters&) const;
+};
+
+inline Instr_counters& instr_counters() {      // the calling thread's counters
+  static thread_local Instr_counters counters;
+  return counters;
+};
+
+// Adds the cycles spent in its scope to a counter
+class Instr_timer {
+public:
+  explicit Instr_timer(unsigned long long& cycles) : total(cycles), t0(now()) {};
+  ~Instr_timer() {total += now() - t0; };
+
+  static unsigned long long now() {
+#ifdef EVOLVE_INSTRUMENT_TSC
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+#else
+    return 0;
+#endif
+  };
+private:
+  unsigned long long& total;
+  unsigned long long  t0;
+};
+
+inline Instr_counters Instr_counters::operator-(const Instr_counters& b) const {
+  Instr_counters d;
+  d.events            = events            - b.events;
+  d.births            = births            - b.births;
+  d.birth_draws       = birth_draws       - b.birth_draws;
+  d.deaths            = deaths            - b.deaths;
+  d.state_chgs        = state_chgs        - b.state_chgs;
+  d.lineages_created  = lineages_created  - b.lineages_created;
+  d.lineages_released = lineages_released - b.lineages_released;
+  d.line_list_pushes  = line_list_pushes  - b.line_list_pushes;
+  d.line_list_pops    = line_list_pops    - b.line_list_pops;
+  d.event_cycles      = event_cycles      - b.event_cycles;
+  d.birth_cycles      = birth_cycles      - b.birth_cycles;
+  d.death_cycles      = death_cycles      - b.death_cycles;
+  d.state_chg_cycles  = state_chg_cycles  - b.state_chg_cycles;
+  return d;
+};
+
+inline std::ostream& operator<<(std::ostream& out, const Instr_counters& c) {
+  const double per_birth = c.births ? 1.0 / c.births : 0.0;
+  out << "|---  Instrumentation  --------------------------------------------|" << std::endl
+      << "events           = " << c.events            << std::endl
+      << "births           = " << c.births
+      << "   draws/birth = "    << c.birth_draws * per_birth                    << std::endl
+      << "deaths           = " << c.deaths            << std::endl
+      << "state_chgs       = " << c.state_chgs        << std::endl
+      << "lineages created = " << c.lineages_created
+      << "   released = "       << c.lineages_released                          << std::endl
+      << "line list pushes = " << c.line_list_pushes
+      << "   pops = "           << c.line_list_pops                             << std::endl;
+#ifdef EVOLVE_INSTRUMENT_TSC
+  out << "cycles/event     = " << (c.events     ? (double) c.event_cycles     / c.events     : 0)
+      << "   /birth = "         << (c.births     ? (double) c.birth_cycles     / c.births     : 0)
+      << "   /death = "         << (c.deaths     ? (double) c.death_cycles     / c.deaths     : 0)
+      << "   /state_chg = "     << (c.state_chgs ? (double) c.state_chg_cycles / c.state_chgs : 0)
+      << std::endl;
+#endif
+  return out;
+};
+
+} // end namespace block
+
+#ifdef EVOLVE_INSTRUMENT
+#define INSTR_COUNT(counter) (++evolve::instr_counters().counter)
+#else
+#define INSTR_COUNT(counter) ((void) 0)
+#endif
+
+#ifdef EVOLVE_INSTRUMENT_TSC
+#define INSTR_TIME(counter) evolve::Instr_timer instr_timer_(evolve::instr_counters().counter)
+#else
+#define INSTR_TIME(counter) ((void) 0)
+#endif
+
+#endif
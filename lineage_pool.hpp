@@ -0,0 +1,162 @@
+//  This header defines Lineage_pool, the store of a Population's lineages.
+//
+//  Lineages are named by 32-bit Lineage_id handles that index a set of parallel arrays, one per
+//  lineage attribute (structure of arrays).  The hot paths of Population read one or two attributes
+//  of a randomly chosen lineage, e.g. allele and tracking flag in birth(), and each such read now
+//  touches a single small array element instead of a whole scattered record.  The slot of a lineage
+//  that dies out goes on a free list and is reused by the next new lineage, so a population in
+//  steady state allocates nothing.  Per-state counts are held in blocks of num_states() entries
+//  per slot.  Birth rates are not stored: they are read from the states' fitness tables by genotype.
+//
+//  A lineage's member count is an ordinary int: only its population adds and removes members, so
+//  there is no atomic reference counting.  The population releases a lineage when the count
+//  reaches 0.
+
+
+#ifndef _LINEAGE_POOL_
+#define _LINEAGE_POOL_
+
+#include <vector>
+#include <assert.h>
+#include <boost/serialization/vector.hpp>
+
+#include "paths.hpp"
+#include ORGANISM
+#include INSTRUMENT
+
+namespace evolve {
+
+// ****************************************************************************
+// *********************          Lineage Pool            *********************
+// ****************************************************************************
+class Lineage_pool {
+public:
+  Lineage_pool();
+
+  Lineage_id create(int allele, bool tracked);  // new, empty lineage; reuses a freed slot if any
+  void release(Lineage_id);                     // lineage has died out, its slot may be reused
+
+  int    allele_state(Lineage_id)      const;
+  bool   tracked(Lineage_id)           const;
+  int    num_in_lineage(Lineage_id)    const;
+  int    num_in_state(Lineage_id, int) const;
+  int    lineage_index(Lineage_id)     const;
+  int    num_live()                    const;   // lineages created and not yet released
+  int    capacity()                    const;   // slots, live or free
+
+  void set_lineage_index(Lineage_id, int);
+  void inc_num_in_state(Lineage_id, int state); // also counts the org in the lineage
+  void dec_num_in_state(Lineage_id, int state);
+private:
+  int n_states;                         // num_states() when the pool was made
+
+  // Lineage attributes, indexed by Lineage_id (by id * n_states + state for st_counts)
+  std::vector<int>    alleles;          // +1, 0, or -1: entire "genome"
+  std::vector<char>   trk_flags;        // Marks lineage as tracked. No physical effect
+  std::vector<int>    n_in_line;        // Num. orgs with identical data via descent
+  std::vector<int>    line_idx;         // Position in population's trk/wld list, -1 if none
+  std::vector<int>    st_counts;        // Num. orgs in lineage in each state
+
+  std::vector<Lineage_id> free_slots;   // Released slots, reused last-in first-out
+
+  // Enable reading/writing of object to archive file
+  friend class boost::serialization::access;
+  template<class Archive>
+  void serialize(Archive & ar, const unsigned int version) {
+    ar & n_states;
+    ar & alleles;
+    ar & trk_flags;
+    ar & n_in_line;
+    ar & line_idx;
+    ar & st_counts;
+    ar & free_slots;
+  };
+};
+
+inline Lineage_pool::Lineage_pool() : n_states(Organism::num_states()) {};
+
+inline int  Lineage_pool::num_live() const {return alleles.size() - free_slots.size(); };
+inline int  Lineage_pool::capacity() const {return alleles.size();                     };
+
+inline int Lineage_pool::allele_state(Lineage_id id) const {
+  assert(id < alleles.size());
+  return alleles[id];
+};
+
+inline bool Lineage_pool::tracked(Lineage_id id) const {
+  assert(id < trk_flags.size());
+  return trk_flags[id];
+};
+
+inline int Lineage_pool::num_in_lineage(Lineage_id id) const {
+  assert(id < n_in_line.size());
+  return n_in_line[id];
+};
+
+inline int Lineage_pool::lineage_index(Lineage_id id) const {
+  assert(id < line_idx.size());
+  return line_idx[id];
+};
+
+inline int Lineage_pool::num_in_state(Lineage_id id, int st) const {
+  assert(id < alleles.size());
+  assert(st >= 0);
+  assert(st < n_states);
+  return st_counts[id * n_states + st];
+};
+
+inline void Lineage_pool::set_lineage_index(Lineage_id id, int i) {
+  assert(id < line_idx.size());
+  assert(i >= 0);
+  line_idx[id] = i;
+};
+
+inline void Lineage_pool::inc_num_in_state(Lineage_id id, int st) {
+  assert(id < alleles.size());
+  assert(st >= 0);
+  assert(st < n_states);
+  ++st_counts[id * n_states + st];
+  ++n_in_line[id];
+};
+
+inline void Lineage_pool::dec_num_in_state(Lineage_id id, int st) {
+  assert(id < alleles.size());
+  assert(st >= 0);
+  assert(st < n_states);
+  assert(st_counts[id * n_states + st] > 0);
+  --st_counts[id * n_states + st];
+  --n_in_line[id];
+};
+
+inline Lineage_id Lineage_pool::create(int allele, bool tracked) {
+  Lineage_id id;
+  INSTR_COUNT(lineages_created);
+  if (free_slots.empty()) {
+    id = alleles.size();
+    assert(id != no_lineage);
+    alleles.push_back(0);
+    trk_flags.push_back(false);
+    n_in_line.push_back(0);
+    line_idx.push_back(-1);
+    st_counts.resize(st_counts.size() + n_states, 0);
+  }
+  else {
+    id = free_slots.back();            // released slots already have zero counts, index -1
+    free_slots.pop_back();
+  };
+  alleles[id]   = allele;
+  trk_flags[id] = tracked;
+  return id;
+};
+
+inline void Lineage_pool::release(Lineage_id id) {
+  assert(id < alleles.size());
+  assert(n_in_line[id] == 0);
+  INSTR_COUNT(lineages_released);
+  line_idx[id] = -1;
+  free_slots.push_back(id);
+};
+
+} //end of evolve namespace
+
+#endif
@@ -1,4 +1,4 @@
-// function definitions for Org_state, Organism_data, and Organism classes
+// function definitions for Org_state and Organism classes
 
 #include <iostream>
 #include <cmath>
@@ -6,35 +6,52 @@
 #include <assert.h>
 #include "paths.hpp"
 #include ORGANISM
+#include LINEAGE_POOL
 #include RV_GENERATORS
 
 namespace evolve{
 
 ptrdiff_t myrandom (ptrdiff_t i) { return rnd_int(i);} //namespace scope function used below
 std::vector<Org_state> Organism::state_list;           // namespace scope static object
+thread_local std::vector<Org_state>* Organism::thread_states = 0;
 
 Org_state& Organism::state(int st) {
-  assert(state_list.size() > 0);
+  assert(num_states() > 0);
   assert(st >= 0);
-  assert(st < (int) state_list.size()); 
-  return state_list[st];
+  assert(st < num_states()); 
+  return states()[st];
 };
 
 
 // *********************** Organism writing functions ***********************
-// ** each calls make_write_safe() which reserves memory for new Org_data  **
-// ** this means you should only call these when a new lineage in created  **
+// ** a changed genome no longer matches the org's lineage, so each detaches **
+// ** the org; its next add_org() starts a new lineage                      **
 // **************************************************************************
 
 
 Organism& Organism::set_tracked(bool trk) {
   if (trk != tracked()) {
-    make_write_safe(data_ptr);
-    data_ptr->set_tracked(trk);
+    is_tracked = trk;
+    reset_lineage_counts();
   };           
   return *this;   
 };
 
+// ************************** Lineage data reading **************************
+int Organism::num_in_lineage() const {
+  return line_pool ? line_pool->num_in_lineage(line) : 0;
+};
+
+int Organism::num_in_state(int st) const {
+  assert(st >= 0);
+  assert(st < num_states());
+  return line_pool ? line_pool->num_in_state(line, st) : 0;
+};
+
+int Organism::lineage_index() const {
+  return line_pool ? line_pool->lineage_index(line) : -1;
+};
+
 // ******************************** Mutation ******************************** 
 /*void Organism::mutate(int st) {
   int up_muts   = rnd_binomial(state(st).up_mut_prob()  ,num_zeros());
@@ -45,49 +62,80 @@ Organism& Organism::set_tracked(bool trk) {
   };
 };*/
 
-bool Organism::mutate( int st) {
+bool Organism::mutate( int st) {return mutate( st, default_rng()); };
+
+bool Organism::mutate( int st, Rng& rng) {
+  int new_allele= mutant_allele( allele_state(), st, rng);
+  if( new_allele != allele_state()) {
+    allele= new_allele;
+    reset_lineage_counts();
+  };
+  return 0;   // this is a relic from when lethal mutations were implemented
+};
+
+// Shared by every population engine, so they all draw mutations the same way
+int Organism::mutant_allele( int allele, int st, Rng& rng) {
   double mut_prob_ben= 1- exp( -state( st).mut_rate_ben() );
   double mut_prob_del= 1- exp( -state( st).mut_rate_del() );
   int allele_change= 0;
   
-  if( allele_state() == 1)
-    allele_change-= rnd_uniform() < mut_prob_del;
+  if( allele == 1)
+    allele_change-= rnd_uniform( rng) < mut_prob_del;
   
-  else if ( allele_state() == 0)  // deleterious genotypes can't mutate in Ben Allen's model
-    allele_change+= ( rnd_uniform() < mut_prob_ben) - ( rnd_uniform() < mut_prob_del );
+  else if ( allele == 0)  // deleterious genotypes can't mutate in Ben Allen's model
+    allele_change+= ( rnd_uniform( rng) < mut_prob_ben) - ( rnd_uniform( rng) < mut_prob_del );
     
-  if( allele_change != 0) {
-    make_write_safe( data_ptr);
-    data_ptr->set_allele_state( allele_state() + allele_change); 
-  };
-  return 0;   // this is a relic from when lethal mutations were implemented
+  return allele+ allele_change;
 };
 
+// Distribution of mutant_allele(), for engines that mutate many replicates at once
+void Organism::mutant_allele_probs( int allele, int st, double probs[3]) {
+  double mut_prob_ben= 1- exp( -state( st).mut_rate_ben() );
+  double mut_prob_del= 1- exp( -state( st).mut_rate_del() );
+  probs[0]= probs[1]= probs[2]= 0.0;
+  
+  if( allele == 1) {
+    probs[1]= mut_prob_del;
+    probs[2]= 1- mut_prob_del;
+  }
+  else if( allele == 0) {
+    probs[0]= ( 1- mut_prob_ben)* mut_prob_del;
+    probs[2]= mut_prob_ben* ( 1- mut_prob_del);
+    probs[1]= 1- probs[0]- probs[2];
+  }
+  else probs[0]= 1.0;
+};
 
-// ************************** Organism constructor  **************************
-// ** new memory reserved each time called.  copy constructor will often be called
-// ** implicitly by vector::push_back(), which will NOT reserve new memory
-
-Organism::Organism() : data_ptr(new Organism_data()) {};  
 
+// ************************** Organism constructor  **************************
+// ** makes no lineage: that happens when the org is first added to a population
 
-// ***********************  Organism data constructor ***********************
-Organism_data::Organism_data() 
-  : is_tracked(false),
-    n_in_lineage(0),
-    line_index(-1),                   // -1's below mean "not yet assigned by pop."
-    n_in_state(Organism::num_states()),
-    allele(0) {}; // zero vector of length num_states() 
+Organism::Organism()
+  : allele(0),
+    is_tracked(false),
+    line(no_lineage),
+    line_pool(0) {};
 
 
 // ********************** Organism-property constructor ***********************
 Org_state::Org_state() 
   : mt_rate_b(0.0),
     mt_rate_d(0.0),
+    s_b(0.0),
+    s_d(0.0),
     b_pre(0.0),
     c_rate (0.0),
     f_adjust(0.0),
-    d_rate(0.0){};
+    d_rate(0.0) {
+  update_fit_table();
+};
+
+// Neutral genotype at b_pre, beneficial and deleterious alleles scaled by (1+ s_b) and (1- s_d)
+void Org_state::update_fit_table() {
+  fit_table[genotype_index( 0)] = b_pre;
+  fit_table[genotype_index( 1)] = b_pre * (1 + s_b);
+  fit_table[genotype_index(-1)] = b_pre * (1 - s_d);
+};
 
 // ******************* Organism-property setting functions  *******************
 // all of these called together in Organism::set_state_params()
@@ -107,6 +155,7 @@ Org_state& Org_state::set_mut_rate_del(double del_mut_rate) {
 Org_state& Org_state::set_sel_coeff_ben(double sel_coeff_ben){
   assert(sel_coeff_ben >= 0.0);
   s_b= sel_coeff_ben;
+  update_fit_table();
   return *this;
 };
 
@@ -114,18 +163,60 @@ Org_state& Org_state::set_sel_coeff_del(double sel_coeff_del){
   assert(sel_coeff_del >= 0.0);
   assert(sel_coeff_del <= 1.0);
   s_d= sel_coeff_del;
+  update_fit_table();
   return *this;
 };
 
 Org_state& Org_state::set_birth_prefactor(double birth_prefactor) {
   assert(birth_prefactor >= 0.0);
   b_pre = birth_prefactor;
+  update_fit_table();
   return *this;
 };
 
+// Also drops any switching table: the 3-state rule applies again
 Org_state& Org_state::set_chg_rate(double change_rate) {
   assert(change_rate >= 0.0);
   c_rate = change_rate;
+  sw_dests.clear();
+  sw_rates.clear();
+  sw_alias_prob.clear();
+  sw_alias.clear();
+  return *this;
+};
+
+// Vose's construction of the alias table: each of the n columns holds probability mass 1/n,
+// split between its own destination (sw_alias_prob) and one other (sw_alias).
+Org_state& Org_state::set_switch_rates(const std::vector<double>& rate_to) {
+  set_chg_rate(0.0);
+  for (unsigned int s = 0; s < rate_to.size(); ++s) {
+    assert(rate_to[s] >= 0.0);
+    if (rate_to[s] > 0.0) {
+      sw_dests.push_back(s);
+      sw_rates.push_back(rate_to[s]);
+      c_rate += rate_to[s];
+    };
+  };
+  const int n = sw_dests.size();
+  sw_alias_prob.resize(n);
+  sw_alias.assign(n, 0);
+  std::vector<int> small, large;
+  for (int k = 0; k < n; ++k) {
+    sw_alias_prob[k] = sw_rates[k] * n / c_rate;
+    (sw_alias_prob[k] < 1.0 ? small : large).push_back(k);
+  };
+  while (not small.empty() and not large.empty()) {
+    const int s = small.back(), l = large.back();
+    small.pop_back();
+    sw_alias[s] = l;
+    sw_alias_prob[l] -= 1.0 - sw_alias_prob[s];
+    if (sw_alias_prob[l] < 1.0) {
+      large.pop_back();
+      small.push_back(l);
+    };
+  };
+  for (unsigned int i = 0; i < small.size(); ++i) sw_alias_prob[small[i]] = 1.0;   // round-off
+  for (unsigned int i = 0; i < large.size(); ++i) sw_alias_prob[large[i]] = 1.0;
   return *this;
 };
 
@@ -136,7 +227,7 @@ Org_state& Org_state::set_death_rate(double dth_rate){
 };
 
 void Organism::add_states(int num_states) {
-  for(int i=0; i<num_states; ++i) state_list.push_back(Org_state());
+  for(int i=0; i<num_states; ++i) states().push_back(Org_state());
 };
 
 
@@ -148,22 +239,49 @@ std::ostream& operator<<(std::ostream& out, const Org_state& props) {
       << "sel_coeff_del   = " << props.sel_coeff_del()   << std::endl
       << "birth_prefactor = " << props.birth_prefactor() << std::endl
       << "change_rate     = " << props.chg_rate()        << std::endl;
+  for (int k = 0; k < props.num_switch_dests(); ++k)
+    out << "  to state " << props.switch_dest(k) << "    = " << props.switch_rate(k) << std::endl;
   return out;
 };
 
 
+// ******************** Equality operators for organism states ********************
+// Equal if every parameter and the switching table are; the fitness and alias tables follow
+bool operator==(const Org_state& a, const Org_state& b) {
+  if (a.mut_rate_del()    != b.mut_rate_del()
+      or a.mut_rate_ben()    != b.mut_rate_ben()
+      or a.sel_coeff_ben()   != b.sel_coeff_ben()
+      or a.sel_coeff_del()   != b.sel_coeff_del()
+      or a.birth_prefactor() != b.birth_prefactor()
+      or a.chg_rate()        != b.chg_rate()
+      or a.death_rate()      != b.death_rate()
+      or a.num_switch_dests() != b.num_switch_dests()) return false;
+  for (int k = 0; k < a.num_switch_dests(); ++k)
+    if (a.switch_dest(k) != b.switch_dest(k) or a.switch_rate(k) != b.switch_rate(k)) return false;
+  return true;
+};
+
+bool operator!=(const Org_state& a, const Org_state& b) {
+  return not (a == b);
+};
+
+
 // ********************* Equality operators for organisms *********************
+// Equal if they have the same genome and belong to the same lineage (or are both unplaced)
 bool operator==(const Organism& org_a, const Organism& org_b) {
-  return org_a.get_ptr() == org_b.get_ptr();
+  return org_a.get_pool()     == org_b.get_pool()
+     and org_a.lineage()      == org_b.lineage()
+     and org_a.allele_state() == org_b.allele_state()
+     and org_a.tracked()      == org_b.tracked();
 };
 
 bool operator!=(const Organism& org_a, const Organism& org_b) {
-  return org_a.get_ptr() != org_b.get_ptr();
+  return not (org_a == org_b);
 };
 
 // ************************ Print organism to output ************************
 std::ostream& operator<<(std::ostream& out, const Organism& org) {
-  out << "org data_ptr   = " << org.get_ptr()   << std::endl
+  out << "lineage        = " << org.lineage()   << std::endl
       << "allele         = " << org.allele_state() <<std::endl;
   out << "tracked        = " << org.tracked()   << std::endl
       << "num_in_lineage = " << org.num_in_lineage() << std::endl
@@ -175,35 +293,46 @@ std::ostream& operator<<(std::ostream& out, const Organism& org) {
   return out;
 };
 
-void Organism::set_state_params(int st, const Parameters& prm) {
+// Names of state st's parameters in a parameter file, in the order set_state_params() reads them
+std::vector<std::string> Organism::state_param_names(int st) {
   std::string state_number;
   string_format(state_number, st);
   std::string suffix = "_s";
   suffix.append(state_number);
 
-  std::string pname_mut_ben     = "mut_ben";
-  std::string pname_mut_del     = "mut_del";
-  std::string pname_s_ben           = "s_ben";
-  std::string pname_s_del           = "s_del";
-  std::string pname_birth_prefactor = "birth_prefactor";
-  std::string pname_log_chg_rate    = "log_chg_rate";
-  std::string pname_death_rate      = "death_rate";
-  
-  pname_mut_ben.append(suffix);
-  pname_mut_del.append(suffix);
-  pname_s_ben.append(suffix);
-  pname_s_del.append(suffix);
-  pname_birth_prefactor.append(suffix);
-  pname_log_chg_rate.append(suffix);
-  pname_death_rate.append(suffix);
-
-  double mut_ben     = prm.get_double(pname_mut_ben); 
-  double mut_del     = prm.get_double(pname_mut_del);      
-  double s_ben           = prm.get_double(pname_s_ben);
-  double s_del           = prm.get_double(pname_s_del);
-  double birth_prefactor = prm.get_double(pname_birth_prefactor);
-  double log_chg_rate    = prm.get_double(pname_log_chg_rate);
-  double death_rate      = prm.get_double(pname_death_rate);
+  const char* pnames[] = {"mut_ben", "mut_del", "s_ben", "s_del", "birth_prefactor",
+                          "log_chg_rate", "death_rate"};
+  std::vector<std::string> names;
+  for (int i = 0; i < 7; ++i) names.push_back(pnames[i] + suffix);
+  return names;
+};
+
+// switch_s<st>_to_s<j> for every other state j
+std::vector<std::string> Organism::switch_param_names(int st) {
+  std::string from;
+  string_format(from, st);
+  std::vector<std::string> names;
+  for (int j = 0; j < num_states(); ++j) {
+    if (j == st) continue;
+    std::string to;
+    string_format(to, j);
+    names.push_back("switch_s" + from + "_to_s" + to);
+  };
+  return names;
+};
+
+// A state switches by the rates switch_s<st>_to_s<j> if any of them is given, otherwise by the
+// 3-state rule at rate 10^log_chg_rate_s<st>; any other state with that rate > 0 aborts
+void Organism::set_state_params(int st, const Parameters& prm) {
+  std::vector<std::string> pname = state_param_names(st);
+
+  double mut_ben     = prm.get_double(pname[0]); 
+  double mut_del     = prm.get_double(pname[1]);      
+  double s_ben           = prm.get_double(pname[2]);
+  double s_del           = prm.get_double(pname[3]);
+  double birth_prefactor = prm.get_double(pname[4]);
+  double log_chg_rate    = prm.get_double(pname[5]);
+  double death_rate      = prm.get_double(pname[6]);
   
   Organism::state(st)      
     .set_mut_rate_ben   (mut_ben  )
@@ -213,6 +342,25 @@ void Organism::set_state_params(int st, const Parameters& prm) {
     .set_birth_prefactor( birth_prefactor)
     .set_chg_rate       (pow(10.0, log_chg_rate))
     .set_death_rate     (death_rate);
+
+  std::vector<std::string> sw_names = switch_param_names(st);
+  std::vector<double> rate_to(num_states(), 0.0);
+  bool has_table = false;
+  for (int j = 0, k = 0; j < num_states(); ++j) {
+    if (j == st) continue;
+    if (prm.has(sw_names[k])) {
+      rate_to[j] = prm.get_double(sw_names[k]);
+      has_table = true;
+    };
+    ++k;
+  };
+  if (has_table) Organism::state(st).set_switch_rates(rate_to);
+  else if (Organism::state(st).chg_rate() > 0 and (num_states() != 3 or st == 0)) {
+    std::cout << "State " << st << " switches at rate 10^" << log_chg_rate << " but has no "
+              << "switch_s" << st << "_to_s<j> rates; without them only states 1 and 2 of "
+              << "the 3-state model can switch." << std::endl;
+    abort();
+  };
 };
 
 void Organism::write_states() {
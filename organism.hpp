@@ -1,14 +1,31 @@
 //  version for Ben Allen's simple 3-level fitness landscape.
 
-//  This header contains definitions for classes Org_state, Organism_data, and Organism, as well as
+//  This header contains definitions for classes Org_state and Organism, as well as
 //  definitions of member inline functions.  Other function definitions are in organism.cpp
 //
 //  Org_state is essentially a set of parameters governing a phenotype. 
+//
+//  Each Org_state keeps a fitness table, the birth rate of every genotype in the state, rebuilt by
+//  the setters of the parameters it depends on.  birth_rate(allele) is a single load from it.
+//  Genotypes are indexed by genotype_index(): the allele + 1 for the present one-locus genome.  A
+//  richer genome (several loci) would only change num_genotypes, genotype_index() and how
+//  update_fit_table() fills the table; callers and the per-lineage caches stay as they are.
+//
+//  Phenotypic switching out of a state follows the state's switching table: a rate to each other
+//  state (set_switch_rates(), or switch_s<i>_to_s<j> parameters), with a Walker alias table so a
+//  switch's destination is drawn in O(1) whatever the number of states.  Without a table the
+//  3-state model's rule applies: states 1 and 2 switch into each other at chg_rate, and state 0
+//  doesn't switch.  Organism::rnd_switch_dest() etc. apply whichever holds.
 // 
-//  Organism is the copy-on-write facade for Organism_data.  These objects represent *lineages* 
-//  of possibly several biological cells identical by descent.  The objects contain a genome, a tracking 
-//  flag, and the phenotypic distribution of the clones they represent.  They also have member 
-//  functions for manipulating the genome (mutate etc.).
+//  Organism is a small value holding a genome and a tracking flag.  Inside a Population, orgs are
+//  stored only as handles (Lineage_id) to *lineages* of cells identical by descent, kept in the
+//  population's Lineage_pool (lineage_pool.hpp).  An Organism obtained from a population also
+//  carries its lineage handle, so it can report the lineage's size and phenotypic distribution,
+//  and adding it to the same population again joins that lineage.  Member functions manipulate
+//  the genome (mutate etc.); a genetic change detaches the org from its lineage.
+//  The org only points at its population's pool: its lineage data are valid while that population
+//  is alive and hasn't been assigned over.  Past that, call reset_lineage_counts() before reading
+//  them or adding the org to a population; its genome and tracking flag stay valid throughout.
 
 // The genome is an integer from {+1, 0, -1}
 
@@ -19,7 +36,6 @@
 #include <vector>
 #include <iostream>
 #include <boost/serialization/vector.hpp>
-#include <boost/serialization/shared_ptr.hpp>
 
 #include "paths.hpp"
 #include RV_GENERATORS
@@ -32,14 +48,22 @@ class Parameters;  // defined elsewhere, needed by Org_state::set_state_params(.
 
 //these classes defined here
 class Org_state;      
-class Organism_data;
 class Organism;
+class Lineage_pool;   // defined in lineage_pool.hpp
+
+typedef unsigned int Lineage_id;              // 32-bit handle of a lineage in a Lineage_pool
+const Lineage_id no_lineage = 0xFFFFFFFF;     // org not (yet) in any population
+
+const int num_genotypes = 3;                  // alleles -1, 0, +1: columns of the fitness tables
+inline int genotype_index(int allele) {assert(allele >= -1 and allele <= 1); return allele + 1; };
 
 //namespace scope function prototypes, defined in .cpp
 bool          operator!= (const Organism&, const Organism& );
 bool          operator== (const Organism&, const Organism& );
 std::ostream& operator<< (std::ostream&,   const Organism& );
 std::ostream& operator<< (std::ostream&,   const Org_state&);
+bool          operator== (const Org_state&, const Org_state&);   // same parameters and switching
+bool          operator!= (const Org_state&, const Org_state&);
 
 
 // ****************************************************************************
@@ -56,6 +80,8 @@ public:
   double birth_prefactor() const;
   double chg_rate()        const; 
   double death_rate()      const;
+  double birth_rate(int allele) const;  // birth rate of a genotype with this allele in this state
+  double genotype_birth_rate(int g) const;  // same, by genotype_index()
   
   // Functions for setting the state's properties, all return a reference
   // to the current state to facilitate chaining of fuction calls.
@@ -66,6 +92,12 @@ public:
   Org_state& set_birth_prefactor (double); 
   Org_state& set_chg_rate        (double);   
   Org_state& set_death_rate      (double);
+  Org_state& set_switch_rates    (const std::vector<double>& rate_to);  // by state; sets chg_rate
+                                                                       // to the total
+  int    num_switch_dests()   const;      // states of the switching table, 0 if there's none
+  int    switch_dest(int k)   const;
+  double switch_rate(int k)   const;
+  int    rnd_switch_dest(Rng&) const;     // one of them, in proportion to their rates
 private:
   double mt_rate_b;   // probability of beneficial mutation per replication
   double mt_rate_d;   // probability of deleterious mutation per replication
@@ -75,8 +107,16 @@ private:
   double c_rate;      // Rate organsim can switch it's state
   double f_adjust;    // Additive adjustement to birth rate
   double d_rate;      // Death rate per unit time
+  std::vector<int>    sw_dests;        // States switched to at non-zero rate (switching table)
+  std::vector<double> sw_rates;        // and the rates
+  std::vector<double> sw_alias_prob;   // Walker alias table over sw_dests
+  std::vector<int>    sw_alias;
+  double fit_table[num_genotypes];     // birth rate by genotype_index(), from b_pre, s_b, s_d
 
-  // Enable reading/writing of object to archive file
+  void update_fit_table();
+
+  // Enable reading/writing of object to archive file.  The fitness table is not stored, but
+  // rebuilt from the parameters.
   friend class boost::serialization::access;
   template<class Archive>
   void serialize(Archive & ar, const unsigned int version) {
@@ -88,6 +128,11 @@ private:
     ar & c_rate;
     ar & f_adjust;
     ar & d_rate;
+    ar & sw_dests;
+    ar & sw_rates;
+    ar & sw_alias_prob;
+    ar & sw_alias;
+    update_fit_table();
   };
 };  
 
@@ -99,178 +144,153 @@ inline double Org_state::sel_coeff_del()   const {return s_d;      };
 inline double Org_state::birth_prefactor() const {return b_pre;    };
 inline double Org_state::chg_rate()        const {return c_rate;   };
 inline double Org_state::death_rate()      const {return d_rate;   };
-
-
-// ****************************************************************************
-// *********************          Organism Data           *********************
-// ****************************************************************************  
-class Organism_data {
-public:
-  friend class Organism;          // Organism needs access to its data
-private:
-  Organism_data();                // Starts with empty genome, not tracked
-
-  bool is_tracked;                // Marks org. as tracked. No physical effect
-  int  n_in_lineage;              // Num. orgs with identical data via descent
-  int  line_index;                // Position of lineage's progenitor in list 
-  std::vector<int> n_in_state;    // Num. orgs in lineage with particular state
-  int allele;                     // +1, 0, or -1: entire "genome"
-  
-  // -----------------------   Data reading functions   -----------------------
-  int     allele_state() const;    
-  int     num_in_lineage()  const;     // Number of orgs identical by descent
-  int     num_in_state(int) const;     // Number of orgs in lineage in each state
-  int     lineage_index()   const;     
-  bool    tracked()         const; 
-  
-  // ------------------   Genome modifying functions   ------------------
-
-  void set_tracked(bool); 
-  void set_allele_state(int);
-
-  // ----------   Helper functions for changing lineage info   ----------
-  void set_lineage_index(int);
-  void inc_num_in_lineage();
-  void dec_num_in_lineage();
-  void inc_num_in_state(int);   // Increment num_in_state counter
-  void dec_num_in_state(int);   // Decrement num_in_state counter
-  
-  // -------   Enable reading/writing of object to archive file   -------
-  friend class boost::serialization::access;
-  template<class Archive>
-  void serialize(Archive & ar, const unsigned int version) {
-    ar & is_tracked;
-    ar & n_in_lineage;
-    ar & line_index;
-    ar & n_in_state;
-    ar & allele;
-  };
+inline int    Org_state::num_switch_dests() const {return sw_dests.size(); };
+inline int    Org_state::switch_dest(int k) const {return sw_dests[k];     };
+inline double Org_state::switch_rate(int k) const {return sw_rates[k];     };
+
+// With a single destination nothing is drawn, so the 3-state model's stream of random numbers
+// is the same as before switching tables.
+inline int Org_state::rnd_switch_dest(Rng& rng) const {
+  assert(not sw_dests.empty());
+  const int n = sw_dests.size();
+  if (n == 1) return sw_dests[0];
+  const double u = rnd_uniform(rng) * n;
+  const int k = (u < n) ? (int) u : n - 1;
+  return (u - k < sw_alias_prob[k]) ? sw_dests[k] : sw_dests[sw_alias[k]];
 };
 
-
-inline bool Organism_data::tracked()        const {return is_tracked;     };
-inline int  Organism_data::allele_state()   const {return allele;         };
-inline int  Organism_data::num_in_lineage() const {return n_in_lineage;   };
-inline int  Organism_data::lineage_index()  const {return line_index;     };
-
-inline void Organism_data::set_allele_state(int g)     {allele = g;       };
-inline void Organism_data::set_tracked(bool trk)       {is_tracked = trk; }; 
-inline void Organism_data::set_lineage_index(int idx)  {line_index = idx; }; 
-inline void Organism_data::inc_num_in_lineage()        {++n_in_lineage;   };
-inline void Organism_data::inc_num_in_state(int st)    {++n_in_state[st]; };
-inline void Organism_data::dec_num_in_lineage()        {--n_in_lineage;   };
-inline void Organism_data::dec_num_in_state(int st)    {--n_in_state[st]; };
+inline double Org_state::birth_rate(int allele) const {return fit_table[genotype_index(allele)]; };
+inline double Org_state::genotype_birth_rate(int g) const {
+  assert(g >= 0 and g < num_genotypes);
+  return fit_table[g];
+};
 
 
 // ****************************************************************************
 // ***************                 Organism                 *******************
-// ****************          (copy-on-write facade)         *******************
 // ****************************************************************************
 
 class Organism {
 public:
   Organism();                             // Org starts with "neutral" genotype (0)
 
-  bool mutate(int state);                  // returns 0 if "lethal" mutation occurred
+  bool mutate(int state, Rng&);            // returns 0 if "lethal" mutation occurred
+  bool mutate(int state);                  // same, drawing from the thread's default_rng()
+  static int mutant_allele(int allele, int state, Rng&);   // allele of a replicate, after mutation
+  static void mutant_allele_probs(int allele, int state, double probs[3]); // P(-1), P(0), P(+1)
   
-  // Data reading functions
+  // Data reading functions.  Lineage data are read from the population the org was taken from or
+  // added to, and are 0 (index -1) for an org that is not in a population.  They are only valid
+  // while that population lives (see above).
   int  num_in_lineage()  const;
   int  num_in_state(int) const;
   int  lineage_index()   const;
   bool tracked()         const; 
   int allele_state()     const;
+  Lineage_id lineage()   const;            // handle in the population's Lineage_pool
  
   // Data setting functions
 
   Organism& set_tracked(bool);
-
-  void inc_num_in_lineage();
-  void dec_num_in_lineage();
-  void set_lineage_index(int);
-  void inc_num_in_state(int);     // Increment num_in_state counter
-  void dec_num_in_state(int);     // Decrement num_in_state counter
-  void reset_lineage_counts();
+  void reset_lineage_counts();             // next add_org() starts a new lineage
                                    
   // Change/access possible organism states, all orgs share set of states.
   static void add_states(int);          // Adds "all 0.0" states
   static void set_state_params(int state, const Parameters&);       
+  static std::vector<std::string> state_param_names(int state);   // as read by set_state_params
+  static std::vector<std::string> switch_param_names(int state);  // optional, switch_s<i>_to_s<j>
   static Org_state& state(int i);       // Allows access to i-th state
   static void write_states(); 
   static int num_states(); 
 
-  
-  // Gets underlying raw pointer to data. DON'T DO ANYTHING WITH THIS!
-  const Organism_data* get_ptr() const {return boost::get_pointer(data_ptr);};
+  // Phenotypic switching out of a state, by its switching table or the 3-state rule (see above)
+  static int    num_switch_dests(int state);
+  static int    switch_dest(int state, int k);
+  static double switch_rate(int state, int k);
+  static int    rnd_switch_dest(int state, Rng&);
+
+  // A thread may run with its own set of states instead of the shared one, e.g. to simulate
+  // several parameter sets at once (driveSweep.cpp).  0 switches back to the shared states.
+  static void set_thread_states(std::vector<Org_state>* states);
+
+  // Lineage pool the org's lineage handle refers to, while its population lives.  DON'T DO
+  // ANYTHING WITH THIS!
+  const Lineage_pool* get_pool() const {return line_pool; };
 
   // Convenient to give ouput operator access
   friend std::ostream& operator<<(std::ostream&, const Organism&);
+  template<int> friend class Basic_population;   // makes orgs that view its lineages
   
   // Enable reading/writing of object to archive file
   friend class boost::serialization::access;
   template<class Archive>
   void serialize(Archive & ar, const unsigned int version) {
-    ar & data_ptr;
-    ar & state_list;
+    ar & allele;
+    ar & is_tracked;
+    ar & states();
   }
+
+  // The states, for archives holding orgs' lineages instead of Organism objects
+  template<class Archive>
+  static void serialize_states(Archive & ar) {ar & states(); };
 private:
-  boost::shared_ptr<Organism_data> data_ptr; // Pointer to actual organism data
-  static std::vector<Org_state> state_list;  // Contains org's possible states
+  Organism(int allele, bool tracked, Lineage_id, const Lineage_pool*);
+
+  int  allele;                              // +1, 0, or -1: entire "genome"
+  bool is_tracked;                          // Marks org. as tracked. No physical effect
+  Lineage_id line;                          // no_lineage until added to a population
+  const Lineage_pool* line_pool;            // pool line refers to; not owned, dangles once the
+                                            // population holding it is destroyed
+  static std::vector<Org_state> state_list; // Contains org's possible states
+  static thread_local std::vector<Org_state>* thread_states;   // overrides state_list if set
+  static std::vector<Org_state>& states();  // the calling thread's states
 };
 
 // *********************** Organism reading functions  ***********************
-inline int    Organism::allele_state() const {return data_ptr->allele;       };
-inline bool   Organism::tracked()      const {return data_ptr->tracked();    };
-inline int    Organism::num_states()         {return state_list.size();      };
+inline int        Organism::allele_state() const {return allele;            };
+inline bool       Organism::tracked()      const {return is_tracked;        };
+inline Lineage_id Organism::lineage()      const {return line;              };
+inline int        Organism::num_states()         {return states().size();   };
 
-
-inline int  Organism::lineage_index() const {
-  return data_ptr->lineage_index();
+inline std::vector<Org_state>& Organism::states() {
+  return thread_states ? *thread_states : state_list;
 };
 
-inline int  Organism::num_in_state(int st) const {
-  return data_ptr->num_in_state(st);
-};
+inline void Organism::set_thread_states(std::vector<Org_state>* sts) {thread_states = sts; };
 
-inline int  Organism::num_in_lineage() const {
-  return data_ptr->num_in_lineage();
+inline int Organism::num_switch_dests(int st) {
+  const Org_state& os = state(st);
+  if (os.num_switch_dests() > 0) return os.num_switch_dests();
+  return (num_states() == 3 and st != 0) ? 1 : 0;
 };
 
-inline int  Organism_data::num_in_state(int st) const {
-  assert(st >= 0);
-  assert(st < (int) n_in_state.size());
-  assert(st < Organism::num_states());
-  return n_in_state[st];
+inline int Organism::switch_dest(int st, int k) {
+  const Org_state& os = state(st);
+  return (os.num_switch_dests() > 0) ? os.switch_dest(k) : 3 - st;
 };
 
-inline void Organism::reset_lineage_counts() {
-  // reserve memory for new org_data w/ 0 in lineage, initialize allele to 0, flag line_index w/ -1
-  make_write_safe(data_ptr);
-  data_ptr->n_in_lineage = 0;
-  fill_n(data_ptr->n_in_state.begin(), Organism::num_states(), 0);
-  data_ptr->line_index = -1;
+inline double Organism::switch_rate(int st, int k) {
+  const Org_state& os = state(st);
+  return (os.num_switch_dests() > 0) ? os.switch_rate(k) : os.chg_rate();
 };
 
-inline void Organism::inc_num_in_lineage() {data_ptr->inc_num_in_lineage(); };
-inline void Organism::dec_num_in_lineage() {data_ptr->dec_num_in_lineage(); };
-
-inline void Organism::inc_num_in_state(int st) {
-  assert(state_list.size() > 0);
-  assert(st >= 0);
-  assert(st < (int) state_list.size()); 
-  data_ptr->inc_num_in_state(st);
+inline int Organism::rnd_switch_dest(int st, Rng& rng) {
+  const Org_state& os = state(st);
+  if (os.num_switch_dests() > 0) return os.rnd_switch_dest(rng);
+  assert(num_states() == 3);                    // 3-state rule: 1 <-> 2, state 0 doesn't switch
+  assert(st != 0);
+  return 3 - st;
 };
 
-inline void Organism::dec_num_in_state(int st) {
-  assert(state_list.size() > 0);
-  assert(st >= 0);
-  assert(st < (int) state_list.size());
-  assert(data_ptr->num_in_state(st) > 0);
-  data_ptr->dec_num_in_state(st);
-};
+inline Organism::Organism(int all, bool trk, Lineage_id id, const Lineage_pool* pool)
+  : allele(all),
+    is_tracked(trk),
+    line(id),
+    line_pool(pool) {};
 
-inline void Organism::set_lineage_index(int i) {
-  assert(i >= 0);
-  data_ptr->set_lineage_index(i);
+inline void Organism::reset_lineage_counts() {
+  line = no_lineage;
+  line_pool = 0;
 };
 
 
@@ -278,4 +298,3 @@ inline void Organism::set_lineage_index(int i) {
 
 
 #endif
-
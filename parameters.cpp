@@ -1,6 +1,9 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <cstdlib>
+#include <cmath>
+#include <cerrno>
 
 #include "paths.hpp"
 #include TEMP_TEMPLATES
@@ -9,45 +12,116 @@
 using namespace std;
 
 namespace evolve{
+Parameters::Parameters() {};
+
 Parameters::Parameters(std::string filename) {
   std::ifstream param_file(filename.c_str());
   if (!param_file) {
-    std::cout << "Couldn't open parameter file.";
+    std::cout << "Couldn't open parameter file " << filename << "." << std::endl;
     abort();
   };
-  while (param_file) {
-    char next_char;
-    param_file.get(next_char);
-    param_string += next_char;
+  std::string line;
+  while (getline(param_file, line)) {
+    std::istringstream words(line);
+    std::string name, eq, value;
+    if (words >> name >> eq >> value and eq == "=") set(name, value);
+  };
+};
+
+void Parameters::set(std::string param_name, std::string value) {
+  if (not has(param_name)) order.push_back(param_name);
+  Value& val = params[param_name];
+  val.text = value;
+  char* end;
+  val.number    = strtod(value.c_str(), &end);
+  val.is_number = (end != value.c_str() and *end == '\0');
+};
+
+void Parameters::override_from(int argc, char** argv) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    std::string::size_type eq = arg.find('=');
+    if (eq != std::string::npos and eq > 0) set(arg.substr(0, eq), arg.substr(eq + 1));
+  };
+};
+
+bool Parameters::has(std::string param_name) const {return params.count(param_name) > 0; };
+
+const Parameters::Value& Parameters::find(const std::string& param_name) const {
+  std::unordered_map<std::string, Value>::const_iterator it = params.find(param_name);
+  if (it == params.end()) {
+    std::cout << "Couldn't find parameter: " << param_name 
+	      << " in parameter file." << std::endl << std::endl;
+    abort();
   };
+  return it->second;
 };
 
 double Parameters::get_double(std::string param_name) const {
-  double param;
-  get_param(param_name, param);
-  return param;
+  const Value& val = find(param_name);
+  if (not val.is_number) {
+    std::cout << "Parameter " << param_name << " = " << val.text << " is not a number." << std::endl;
+    abort();
+  };
+  return val.number;
 };
 
 int Parameters::get_int(std::string param_name) const {
-  int param;
-  get_param(param_name, param);
+  double param = get_double(param_name);
+  if (param != floor(param)) {
+    std::cout << "Parameter " << param_name << " = " << param << " is not an integer." << std::endl;
+    abort();
+  };
+  return (int) param;
+};
+
+// Read from the text, not the double, so that every value up to 2^64 - 1 is exact
+unsigned long long Parameters::get_uint64(std::string param_name) const {
+  const Value& val = find(param_name);
+  const char* text = val.text.c_str();
+  char* end;
+  errno = 0;
+  unsigned long long param = strtoull(text, &end, 10);
+  if (end == text or *end != '\0' or errno == ERANGE or val.text[0] == '-') {
+    std::cout << "Parameter " << param_name << " = " << val.text
+              << " is not an unsigned 64-bit integer." << std::endl;
+    abort();
+  };
   return param;
 };
 
 bool Parameters::get_bool(std::string param_name) const {
-  bool param;
-  get_param(param_name, param);
-  return param;
+  const Value& val = find(param_name);
+  if (val.text == "true")  return true;
+  if (val.text == "false") return false;
+  return get_int(param_name) != 0;
 };
 
-std::string Parameters::get_string(std::string param_name) const {
-  std::string param;
-  get_param(param_name, param);
-  return param;
+std::string Parameters::get_string(std::string param_name) const {return find(param_name).text; };
+
+void Parameters::check_names(const std::vector<std::string>& names,
+                             const std::vector<std::string>& optional) const {
+  std::unordered_map<std::string, bool> known;
+  for (unsigned int i = 0; i < optional.size(); ++i) known[optional[i]] = true;
+  bool ok = true;
+  for (unsigned int i = 0; i < names.size(); ++i) {
+    known[names[i]] = true;
+    if (not has(names[i])) {
+      std::cout << "Missing parameter: " << names[i] << std::endl;
+      ok = false;
+    };
+  };
+  for (unsigned int i = 0; i < order.size(); ++i)
+    if (not known.count(order[i])) {
+      std::cout << "Unknown parameter: " << order[i] << std::endl;
+      ok = false;
+    };
+  if (not ok) abort();
 };
 
 std::ostream& operator<<(std::ostream& out, const Parameters& prm) {
-  out << prm.param_string << std::endl;
+  for (unsigned int i = 0; i < prm.order.size(); ++i)
+    out << prm.order[i] << " = " << prm.find(prm.order[i]).text << std::endl;
   return out;
 };
 
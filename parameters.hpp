@@ -1,5 +1,10 @@
-// This is a fairly generic, nifty class for obtaining parameters from a file.  The file's contents
-// are stored in a string, from which the actual values can be extracted with member functions.  
+// This is a fairly generic, nifty class for obtaining parameters from a file.  The file is read once
+// into a hash map from parameter name to value, so each get_*() is an exact-name lookup.  A 
+// parameter is a line "name = value", optionally followed by a comment; other lines are ignored.
+// Numeric values are converted when the file is read.
+//
+// Command-line arguments "name=value" override the file (see override_from()), and check_names()
+// lets a driver reject misspelled or missing parameters before any simulation starts.
 
 
 #ifndef _PARAMETERS_
@@ -10,6 +15,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <unordered_map>
 
 #include "paths.hpp"
 #include TEMP_TEMPLATES
@@ -24,37 +30,35 @@ std::ostream& operator<<(std::ostream&, const Parameters&);
 
 class Parameters {
 public:
+  Parameters();                                  // no parameters
   explicit Parameters(std::string filename);
 
   double get_double(std::string param_name) const;
   int get_int(std::string param_name) const;
+  unsigned long long get_uint64(std::string param_name) const;   // exact, e.g. for 64-bit seeds
   bool get_bool(std::string param_name) const;
   std::string get_string(std::string param_name) const;
+  bool has(std::string param_name) const;
 
-  friend std::ostream& operator<<(std::ostream& out, const Parameters&);
-private:
-  std::string param_string;
+  void set(std::string param_name, std::string value);   // replaces value, or adds parameter
+  void override_from(int argc, char** argv);             // "name=value" arguments, others ignored
 
-  template<typename T>
-  void get_param(std::string param_name, T& param) const; 
-};
+  // Aborts listing every parameter in neither list (misspelled?) and every name not given
+  void check_names(const std::vector<std::string>& names,
+                   const std::vector<std::string>& optional = std::vector<std::string>()) const;
 
-template<typename T>
-void Parameters::get_param(std::string param_name, T& param) const {
-  std::string::size_type loc = param_string.find(param_name, 0);
-  if( loc != std::string::npos ) {
-    std::stringstream oss(param_string);
-    oss.seekg(loc);
-    std::string chunk;
-    oss >> chunk >> chunk >> param;
-  } 
-  else {
-    std::cout << "Couldn't find parameter: " << param_name 
-	      << " in parameter file." << std::endl << std::endl;
-    abort();
+  friend std::ostream& operator<<(std::ostream& out, const Parameters&);
+private:
+  struct Value {
+    std::string text;
+    double      number;
+    bool        is_number;
   };
-};
+  std::unordered_map<std::string, Value> params;
+  std::vector<std::string> order;                  // names in the order they were first given
 
+  const Value& find(const std::string& param_name) const;
+};
 
 } // end namespace block
 
@@ -2,10 +2,19 @@
 #define _PATHS__
 
 #define POPULATION "population.hpp"
+#define CLASS_POPULATION "class_population.hpp"
 #define ORGANISM "organism.hpp"
+#define LINEAGE_POOL "lineage_pool.hpp"
 #define RV_GENERATORS "rv_generators.hpp"
 #define TEMP_TEMPLATES "temp_templates.hpp"
+#define SUM_TREE "sum_tree.hpp"
+#define INDEXED_HEAP "indexed_heap.hpp"
+#define BINARY_ARCHIVE "binary_archive.hpp"
 #define PARAMETERS "parameters.hpp"
 #define EXPERIMENT "experiment.hpp"
+#define TRIAL_RUNNER "trial_runner.hpp"
+#define TRAJECTORY "trajectory.hpp"
+#define SPSC_QUEUE "spsc_queue.hpp"
+#define INSTRUMENT "instrument.hpp"
 
 #endif
\ No newline at end of file
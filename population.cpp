@@ -1,23 +1,28 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <limits>
 #include <assert.h>
 
 #include "paths.hpp"
 #include POPULATION
 #include ORGANISM
+#include LINEAGE_POOL
 #include RV_GENERATORS
 #include TEMP_TEMPLATES
 
 using namespace std;
 namespace evolve{
 
-Population::Population()
-  : b_rate_tots  (Organism::num_states()),
-    sum_sq_b_rates(Organism::num_states()),
-    b_rate_ubnds (Organism::num_states()),
-    tot_rates    (Organism::num_states()),
-    orgs               (Organism::num_states()),
+template<int N>
+Basic_population<N>::Basic_population()
+  : b_rate_tots  (new_states<double>()),
+    sum_sq_b_rates(new_states<double>()),
+    tot_rates    (new_states<double>()),
+    orgs               (new_states<Genotype_lists>()),
+    state_trees_on     (num_states() > linear_scan_states),
+    nr_valid           (false),
+    nr_time            (0.0),
     tot_event_rate     (0.0),
     n_orgs             (0),
     n_births           (0),
@@ -28,33 +33,43 @@ Population::Population()
     n_trk_orgs         (0),
     n_trk_births       (0),
     n_trk_deaths       (0),
-    n_trk_state_chg    (0) {};
+    n_trk_state_chg    (0) {
+  if (state_trees())
+    for (int st = 0; st < num_states(); ++st) {
+      state_rate_tree.push_back(0.0);
+      state_count_tree.push_back(0);
+    };
+};
     
-double Population::birth_rate() const {
+template<int N>
+double Basic_population<N>::birth_rate() const {
   double tot = 0;
-  for (int i=0; i<Organism::num_states(); ++i) {
+  for (int i=0; i<num_states(); ++i) {
     tot += b_rate_tots[i];
   };
   return tot;
 };
 
-double Population::sum_squared_birth_rate() const {
+template<int N>
+double Basic_population<N>::sum_squared_birth_rate() const {
   double tot= 0;
-  for( int st= 0; st< Organism::num_states(); ++st)
+  for( int st= 0; st< num_states(); ++st)
     tot += sum_sq_b_rates[ st];
   return tot;
 };
 
 
 
-double Population::death_rate() const {
+template<int N>
+double Basic_population<N>::death_rate() const {
   double tot = 0;
-  for (int st=0; st < Organism::num_states(); ++st)
-    tot += (orgs[st].size() * Organism::state(st).death_rate());
+  for (int st=0; st < num_states(); ++st)
+    tot += (num_in_state(st) * Organism::state(st).death_rate());
   return tot;
 };
 
-void Population::reset_counts() {
+template<int N>
+void Basic_population<N>::reset_counts() {
   n_births    = 0;
   n_deaths    = 0;
   n_state_chg = 0;
@@ -63,151 +78,164 @@ void Population::reset_counts() {
   n_trk_state_chg = 0;
 };
 
-void Population::add_rates(const Organism& org, int st) {
-  assert(st >= 0);
-  assert(st < Organism::num_states());
-
-  const Org_state& os = Organism::state(st);
-  double fit = org_birth_rate(org, st);
-  double tot = ( os.chg_rate() + os.death_rate() + fit);
-  tot_event_rate += tot;
-  tot_rates[st] += tot;
-  b_rate_tots[st] += fit;
-  sum_sq_b_rates[ st]+= fit* fit;
-  //n_ones        += org.num_ones();
-  if (fit > b_rate_ubnds[st]) 
-    b_rate_ubnds[st] = fit;
-};
-
-void Population::remove_rates(const Organism& org, int st) {
+// org joins its lineage if it came from this population and the lineage is still alive with the
+// same genome; otherwise a new lineage is started, and org is pointed at it for later calls.
+template<int N>
+void Basic_population<N>::add_org(Organism& org, int st) {
+  nr_valid = false;
+  if (N > 0 and Organism::num_states() != N) {
+    std::cout << "Basic_population<" << N << "> needs " << N << " organism states, not "
+              << Organism::num_states() << "." << std::endl;
+    abort();
+  };
   assert(st >= 0);
-  assert(st < Organism::num_states());
-
-  const Org_state& os = Organism::state(st);
-  double fit = org_birth_rate(org, st);
-  double tot = (os.chg_rate() + os.death_rate() + fit);
-  tot_event_rate -= tot;
-  b_rate_tots[st] -= fit;
-  sum_sq_b_rates[ st]-= fit* fit;
-  tot_rates[st] -= tot;
+  assert(st < (int) orgs.size());
+  assert(st < (int) num_states());
 
+  if (org.get_pool() != &lineages
+      or lineages.num_in_lineage(org.lineage()) == 0
+      or lineages.allele_state(org.lineage()) != org.allele_state()
+      or lineages.tracked(org.lineage()) != org.tracked()) {
+    org.line      = lineages.create(org.allele_state(), org.tracked());
+    org.line_pool = &lineages;
+  };
+  add_member(org.lineage(), st);
 };
 
-void Population::add_org(Organism& org, int st) {
-  assert(st >= 0);
-  assert(st < (int) orgs.size());
-  assert(st < (int) Organism::num_states());
-
-  orgs[st].push_back(org);
-  
-  add_rates(org, st);         // two important helper functions called here
-  add_to_lineage_data(org, st);
+template<int N>
+void Basic_population<N>::add_member(Lineage_id id, int st) {
+  push_org(id, st);
+  add_to_lineage_data(id, st);
   
   ++n_orgs;
-  if (org.tracked()) ++n_trk_orgs;
+  if (lineages.tracked(id)) ++n_trk_orgs;
 };
 
-void Population::death(int st){
+template<int N>
+void Basic_population<N>::death(int st){
+INSTR_TIME(death_cycles);
+INSTR_COUNT(deaths);
 assert(st >=0);
-assert(st < Organism::num_states());
-assert(orgs[st].size() > 0);  // someone here to kill
+assert(st < num_states());
+assert(num_in_state(st) > 0);  // someone here to kill
 
-uint ch = rnd_int(orgs[st].size());
+int ch = rnd_int(rand_gen, num_in_state(st));
+const int g = locate(st, ch);
+const Lineage_id id = orgs[st][g][ch];
+const bool trk = lineages.tracked(id);
 // Remove dead organisms rates/lineage info
-  remove_rates(orgs[st][ch], st);    
-  remove_from_lineage_data(orgs[st][ch], st);
+  remove_from_lineage_data(id, st);    // may release the lineage, so tracked() was read first
   
   --n_orgs;
   ++n_deaths;
-  if (orgs[st][ch].tracked()) {
+  if (trk) {
     --n_trk_orgs;
     ++n_trk_deaths;
   };
   
-  swap_pop(orgs[st], ch); 
+  pop_org(st, g, ch); 
 };
 
 
-void Population::state_changer(int st) {
-  // This changer designed for 3 state system
-  assert(Organism::num_states() == 3);     
-  assert(orgs.size() == 3);                   // really, again checking there're 3 states 
-  assert(st != 0);                                // State zero shouldn't switch (by fiat)
+template<int N>
+int Basic_population<N>::state_changer(int st) {
+  INSTR_TIME(state_chg_cycles);
+  INSTR_COUNT(state_chgs);
   assert(num_in_state( st) > 0);
   
-  int ch = rnd_int(orgs[st].size());
+  int ch = rnd_int(rand_gen, num_in_state(st));
   // std::cout << "organism number " << ch << std::endl;
-  Organism org = orgs[st][ch];  // same pointer
+  const int g = locate(st, ch);
+  const Lineage_id id = orgs[st][g][ch];
 
-  // Essentially kill orgs[st][ch], but w/out possibility of removing lineage from progenitor list
-  org.dec_num_in_state(st);     
-  org.dec_num_in_lineage();     
-  remove_rates(org, st);
+  // Essentially kill orgs[st][g][ch], but w/out possibility of removing lineage from progenitor list
+  lineages.dec_num_in_state(id, st);     
 
   assert(ch >= 0);
-  assert(ch < (int) orgs[st].size());
-  swap_pop(orgs[st], ch);
+  assert(ch < (int) orgs[st][g].size());
+  pop_org(st, g, ch);
   --n_orgs;
   
-  // this necessary b/c add_org increments n_trk_orgs if tracked
-  if (org.tracked()) --n_trk_orgs;
+  // this necessary b/c add_member increments n_trk_orgs if tracked
+  if (lineages.tracked(id)) --n_trk_orgs;
 
-  // Add in new organism in new state
-  if (st == 1) add_org(org, 2);     
-  else {
-    assert(st == 2);
-    add_org(org, 1);  
-  };
+  // Add in new organism in new state, by the state's switching table (or 1 <-> 2 for 3 states)
+  const int new_st = Organism::rnd_switch_dest(st, rand_gen);
+  add_member(id, new_st);
 
   ++n_state_chg;
-  if (org.tracked()) ++n_trk_state_chg;
+  if (lineages.tracked(id)) ++n_trk_state_chg;
+  return new_st;
 };
 
-void Population::hack_st_change(int num_to_switch){  
-  for (int i = 0; i < num_to_switch; ++i){
-    int ind_ch = rnd_int(orgs[0].size());
-    Organism newguy = orgs[0][ind_ch];
+template<int N>
+void Basic_population<N>::hack_st_change(int num_to_switch){inject_tracked(num_to_switch, 0, 1); };
+
+// All of a population's storage is flat arrays (orgs' lineage ids, lineage attributes, state
+// trees), so the copy is a few block copies with no per-org or per-lineage allocation.
+template<int N>
+Basic_population<N> Basic_population<N>::branch(const Rng& rng) const {
+  Basic_population copy(*this);
+  copy.set_rng(rng);
+  copy.reset_counts();
+  copy.gens = 0.0;
+  return copy;
+};
+
+template<int N>
+void Basic_population<N>::inject_tracked(int num, int from_st, int to_st) {
+  assert(from_st >= 0);
+  assert(from_st < num_states());
+  assert(to_st >= 0);
+  assert(to_st < num_states());
+  assert(num <= num_in_state(from_st));
+  nr_valid = false;
+  for (int i = 0; i < num; ++i){
+    int ind_ch = rnd_int(rand_gen, num_in_state(from_st));
+    const int g = locate(from_st, ind_ch);
+    const Lineage_id id = orgs[from_st][g][ind_ch];
+    const int allele = lineages.allele_state(id);
+    if (lineages.tracked(id)) --n_trk_orgs;
     
-    remove_rates(orgs[0][ind_ch], 0);
-    remove_from_lineage_data(orgs[0][ind_ch],0);  
-    swap_pop(orgs[0], ind_ch);
+    remove_from_lineage_data(id, from_st);  
+    pop_org(from_st, g, ind_ch);
     --n_orgs;
     
-    newguy.reset_lineage_counts();
-    newguy.set_tracked(1);
-    add_org(newguy, 1);  
+    add_member(lineages.create(allele, true), to_st);    // a new, tracked lineage
    };
 };
 
-void Population::update_birth_ub() {           // explicitly update birth rate upper bounds by state
-  for( int st= 0; st< Organism::num_states(); ++st) {
-    b_rate_ubnds[ st]= 0.0;
-    for( int who= 0; who< orgs[ st].size(); ++who)
-      if( org_birth_rate( orgs[ st][ who], st) > b_rate_ubnds[ st] )
-        b_rate_ubnds[ st]= org_birth_rate( orgs[ st][ who], st );
-  };
-};
-        
-
-  
-void Population::do_event() {
+template<int N>
+void Basic_population<N>::do_event() {
+  INSTR_TIME(event_cycles);
+  INSTR_COUNT(events);
+  nr_valid = false;
     
-  double ch = rnd_uniform() * event_rate();
+  double ch;
   int st = 0;
-  while ((ch -= tot_rates[st]) > 0) { ++st; };
+  if (state_trees()) {                   // as the walk below, ch left at (walked sum - target)
+    double target;
+    do {
+      target = rnd_uniform(rand_gen) * state_rate_tree.total();
+      st = state_rate_tree.find(target);
+    } while (state_rate_tree.weight(st) <= 0.0);   // only through round-off
+    ch = target - state_rate_tree.prefix(st + 1);
+  }
+  else {
+    ch = rnd_uniform(rand_gen) * event_rate();
+    while ((ch -= tot_rates[st]) > 0) { ++st; };
+  };
   assert(st >= 0);  
-  assert(st < Organism::num_states());  
+  assert(st < num_states());  
 
   if ((ch += b_rate_tots[st]) > 0) {
     birth(st);
     
-  int death_st= 0;
-  int death_ch= rnd_int( num_orgs() );
-  while( ( death_ch -= orgs[ death_st].size() ) >= 0 ) ++death_st;  
-  death( death_st);                       // Moran process: call death after every birth
+  int death_ch= rnd_int( rand_gen, num_orgs() );
+  death( rnd_org_state( death_ch) );      // Moran process: call death after every birth
     
   }
-  else if ((ch +=(orgs[st].size() * Organism::state(st).death_rate() )) > 0)
+  else if ((ch +=(num_in_state(st) * Organism::state(st).death_rate() )) > 0)
     death(st);
   
   else {
@@ -217,7 +245,85 @@ void Population::do_event() {
   };
 };
 
-std::ostream& operator<<(std::ostream& out, const Population& pop) {
+template<int N>
+double Basic_population<N>::channel_rate(int chan) const {
+  const int st = chan / 3;
+  const int n = num_in_state(st);
+  if (n == 0) return 0.0;
+  switch (chan % 3) {
+  case 0:  return b_rate_tots[st];
+  case 1:  return n * Organism::state(st).death_rate();
+  default: return n * Organism::state(st).chg_rate();
+  };
+};
+
+template<int N>
+void Basic_population<N>::reset_next_times() {
+  const int n_chan = 3 * num_states();
+  next_times.assign(n_chan, std::numeric_limits<double>::infinity());
+  chan_rates.assign(n_chan, 0.0);
+  for (int c = 0; c < n_chan; ++c) {
+    chan_rates[c] = channel_rate(c);
+    if (chan_rates[c] > 0) next_times.set(c, nr_time + rnd_expo(rand_gen, chan_rates[c]));
+  };
+  nr_valid = true;
+};
+
+// A channel whose rate changed from a to a' keeps its remaining waiting time scaled by a/a'.  One
+// whose rate was 0 gets a fresh exponential time, which is equivalent since waiting times are
+// memoryless.
+template<int N>
+void Basic_population<N>::update_next_times(int st) {
+  for (int c = 3 * st; c < 3 * st + 3; ++c) {
+    const double rate = channel_rate(c);
+    if (rate == chan_rates[c]) continue;
+    double t = std::numeric_limits<double>::infinity();
+    if (rate > 0)
+      t = (chan_rates[c] > 0) ? nr_time + (next_times.key(c) - nr_time) * chan_rates[c] / rate
+                              : nr_time + rnd_expo(rand_gen, rate);
+    chan_rates[c] = rate;
+    next_times.set(c, t);
+  };
+};
+
+template<int N>
+double Basic_population<N>::next_reaction_step() {
+  if (not nr_valid) reset_next_times();
+  const int chan = next_times.top();
+  const double t_fire = next_times.key(chan);
+  assert(t_fire < std::numeric_limits<double>::infinity());  // some channel has a positive rate
+  const double dt = t_fire - nr_time;
+  nr_time = t_fire;
+
+  const int st = chan / 3;
+  int other_st = st;                                // the other state the event touched, if any
+  INSTR_COUNT(events);
+  switch (chan % 3) {
+  case 0: {
+    birth(st);
+    int death_ch = rnd_int(rand_gen, num_orgs());
+    other_st = rnd_org_state(death_ch);
+    death(other_st);                                // Moran process: death after every birth
+    break;
+  }
+  case 1:
+    death(st);
+    break;
+  default:
+    other_st = state_changer(st);
+  };
+
+  // The fired channel draws a new time; the others touched keep theirs, rescaled
+  chan_rates[chan] = channel_rate(chan);
+  next_times.set(chan, (chan_rates[chan] > 0) ? nr_time + rnd_expo(rand_gen, chan_rates[chan])
+                                              : std::numeric_limits<double>::infinity());
+  update_next_times(st);
+  if (other_st != st) update_next_times(other_st);
+  return dt;
+};
+
+template<int N>
+std::ostream& operator<<(std::ostream& out, const Basic_population<N>& pop) {
   out << "|---  Population  -------------------------------------------------|"
       << std::endl
       << "tot_event_rate = " << pop.event_rate()        << std::endl
@@ -227,37 +333,44 @@ std::ostream& operator<<(std::ostream& out, const Population& pop) {
       << "trk_lineages   = " << pop.num_trk_lineages()  << std::endl
       << "num_trk_orgs   = " << pop.num_trk_orgs()      << std::endl
       << "state_b_rates  = [ ";
-  for (int i=0; i<Organism::num_states(); ++i)
+  for (int i=0; i<pop.num_states(); ++i)
     out << pop.b_rate_tots[i] << " ";
   out << "]" << std::endl;
   out << "state_b_ubnds  = [ ";
-  for (int i=0; i<Organism::num_states(); ++i)
-    out << pop.b_rate_ubnds[i] << " ";
+  for (int i=0; i<pop.num_states(); ++i)
+    out << pop.birth_rate_ubound(i) << " ";
   out << "]" << std::endl;
   out << "tot_rates= [ ";
-  for (int i=0; i<Organism::num_states(); ++i)
+  for (int i=0; i<pop.num_states(); ++i)
     out << pop.tot_rates[i] << " ";
   out << "]" << std::endl;
   for(uint i=0; i<pop.orgs.size(); ++i) {
     out << "--------  "
 	<< endl<<"Organisms in state " << i  
 	<< "  -----------------------------" << std::endl;
-    for(uint j=0; j<pop.orgs[i].size(); ++j) { 
-      out << pop.orgs[i][j];
+    for(int j=0; j<pop.num_in_state(i); ++j) { 
+      out << pop.org(i, j);
       out << "----------------------------------------------------------"
 	  << std::endl;
     };
   };
   out << "---- Tracked Lineages ---------" << std::endl;
   for(int i=0; i < pop.num_trk_lineages(); ++i) {
-    out << pop.trk_lines[i] << std::endl;
+    out << pop.trk_prog(i) << std::endl;
   };
   out << "---- Wild Lineages ---------" << std::endl;
   for(int i=0; i < pop.num_wld_lineages(); ++i) {
-    out << pop.wld_lines[i] << std::endl;
+    out << pop.wld_prog(i) << std::endl;
   };
   
   return out;
 };
 
+// ***********   Numbers of states a population can be compiled for   ***********
+template class Basic_population<0>;
+template class Basic_population<3>;
+
+template std::ostream& operator<<(std::ostream&, const Population&);
+template std::ostream& operator<<(std::ostream&, const Population3&);
+
 }
@@ -1,54 +1,110 @@
-//  This header defines the Population class, which holds Organism objects.  The number of member
-//  Organisms equals the census size.  However, the number of underlying Organism_data objects, i.e.
-//  the number of distinct lineages, is generally smaller than this.  Representatives of each lineage
-//  are stored trk_lines, wld_lines, depending on their tracking flag status.  
+//  This header defines the Population class, which holds organisms.  Each member organism is stored
+//  as the handle of its lineage in the population's Lineage_pool, so the number of handles equals the
+//  census size, while the number of lineages (orgs identical by descent) is generally smaller.  The
+//  handles of the lineages are listed in trk_lines, wld_lines, depending on their tracking flag.
 //  
 //  The total rates associated with each type of event are stored as data members.  
 //
+//  An org's birth rate depends only on its state and genotype (Org_state's fitness table), so the
+//  orgs of each state are kept in one list per genotype.  birth() picks the parent's genotype in
+//  proportion to (number of orgs) x (fitness), then the parent uniformly in that list, in O(1).
+//  A state's rate totals are recomputed from the list sizes whenever one changes, and the
+//  population's total rate from the states' totals, so they carry no round-off from incremental
+//  updates.
+//
 //  Member functions include do_event(), imlementing Gillespie's algorithm for stochastically 
 //  choosing which Poisson process occurs.  Also, there are functions for birth, death, mutation,
 //  and phenotypic switching.   
+//
+//  do_event() and rnd_org() choose a state by walking the per-state rates or counts, which is the
+//  fastest way for a few states.  With more than linear_scan_states states they instead search
+//  Sum_trees of the per-state rates and counts, kept up to date as orgs come and go, so the
+//  choice costs O(log #states).  The rate tree only picks states; its total, updated incrementally,
+//  is not used as the event rate.
+//
+//  next_reaction_step() is an alternative to do_event(), Gibson and Bruck's next-reaction method.
+//  Every channel (birth, death and state change in each state) keeps a putative firing time in an
+//  Indexed_heap; the earliest fires, and only the channels of the states it touched get new times,
+//  rescaled to their new rates.  The putative times are dropped whenever the population is changed
+//  any other way (add_org(), do_event(), ...), and drawn afresh by the next step.
+//
+//  Population is Basic_population<0>, whose per-state arrays are std::vectors sized at run time by
+//  Organism::num_states(), for any number of states.  Basic_population<NStates> holds them in
+//  std::arrays instead, and its loops over the states have a constant bound, so that the compiler
+//  can unroll the rate sums and state walks.  Population3 is the one compiled for the 3-state
+//  model, and add_org() aborts unless exactly 3 states were added.  Both run the same process with
+//  the same random numbers, and save and load the same way.
 
 
 #ifndef _POPULATION_
 #define _POPULATION_
 
+#include <array>
 #include <vector>
 #include <iostream>
 #include <assert.h>
+#include <boost/serialization/array.hpp>
 #include <boost/serialization/vector.hpp>
 
 #include "paths.hpp"
 #include ORGANISM
+#include LINEAGE_POOL
 #include RV_GENERATORS
 #include TEMP_TEMPLATES
+#include SUM_TREE
+#include INDEXED_HEAP
+#include INSTRUMENT
 
 using namespace std;
 namespace evolve {
 
 typedef unsigned int uint;
-class Population;                                       // defined below
-ostream& operator<<(std::ostream&, const Population&);  //namespace scope function defined in .cpp
+template<int NStates> class Basic_population;           // defined below
+typedef Basic_population<0> Population;                // any number of states
+typedef Basic_population<3> Population3;                // the 3-state model
+typedef std::array<std::vector<Lineage_id>, num_genotypes> Genotype_lists;  // by genotype_index()
+template<int NStates>                                   //namespace scope function defined in .cpp
+ostream& operator<<(std::ostream&, const Basic_population<NStates>&);
+
+// Storage of one T per state: std::array if the number of states is fixed, else std::vector
+template<class T, int NStates> struct State_storage {
+  typedef std::array<T, NStates> type;
+  static type make(int) {type a; a.fill(T()); return a; };
+};
+template<class T> struct State_storage<T, 0> {
+  typedef std::vector<T> type;
+  static type make(int n) {return type(n); };
+};
 
 // ****************************************************************************
 // ***********************          Population          ***********************
 // ****************************************************************************
-class Population {
+template<int NStates>
+class Basic_population {
 public:
   //void state_changer(int state);
-  Population();                                  // Construct empty population
+  Basic_population();                            // Construct empty population
   
   void set_pop_capacity(int);                   // could be fixed N or logistic carrying capacity
+  void set_rng(const Rng&);                     // e.g. Rng(master_seed, trial) for a reproducible trial
+  Rng& rng() const;                             // generator driving this population's events
   
   void do_event();                         // Chooses which Poisson process occurs (birth/death,etc)  
-  void hack_st_change(int num_to_switch);       // quick fix for adding tracked orgs to burned pop
-  void update_birth_ub();                  // explicitly update upper bound of birth rate
+  double next_reaction_step();             // same, by the next-reaction method; returns time advanced
+  void hack_st_change(int num_to_switch);       // inject_tracked(num_to_switch, 0, 1)
+
+  // Branching trials off one burned-in (or loaded) population: branch() copies it with its own
+  // generator and zeroed counters, then inject_tracked() turns num random orgs of from_state
+  // into tracked mutants in to_state, each starting its own lineage.
+  Basic_population branch(const Rng&) const;
+  void inject_tracked(int num, int from_state, int to_state);
 
   void add_org(Organism& org, int state);
 
   double event_rate() const;                 // birth + death  + change state
  
   double org_birth_rate(const Organism&, int state) const;
+  double birth_rate_ubound(int state) const;  // largest birth rate of any org in state
   double birth_rate()             const;      // birth rate depends on genome, so must be calculated
   double sum_squared_birth_rate() const;
   double death_rate()             const;     
@@ -78,21 +134,33 @@ public:
   void reset_counts();            // Resets birth/death/state-chg counts.  called if
                                   // population loaded from file
 
-  const Organism& org(int st, int i) const; // if you MUST deal directly with Organism's interface
-  const Organism& rnd_org() const;
-  const Organism& trk_prog(int) const;
-  const Organism& wld_prog(int) const;
+  Organism org(int st, int i) const;       // if you MUST deal directly with Organism's interface
+  Organism rnd_org() const;                // (orgs made from the stored lineage handles)
+  Organism trk_prog(int) const;
+  Organism wld_prog(int) const;
 
-  friend std::ostream& operator<<(std::ostream& out, const Population& pop);
+  friend std::ostream& operator<< <>(std::ostream& out, const Basic_population& pop);
+  friend class Population_bench;            // driveBenchmark.cpp times the private event functions
 private:  
-  std::vector<double> b_rate_tots;          // Birth-rate totals by state.  other rate totals
+  template<class T> using State_array = typename State_storage<T, NStates>::type;
+
+  State_array<double> b_rate_tots;          // Birth-rate totals by state.  other rate totals
                                             // easily calculated, thus not stored
-  std::vector<double> sum_sq_b_rates;       // sum of squared birth rates for computing variance[br]
-  std::vector<double> b_rate_ubnds;         // Birth-rate upper bounds by state
-  std::vector<double> tot_rates;            // Each states tot event rate 
-  std::vector<std::vector<Organism> > orgs; // Orgs in pop. organized by state
-  std::vector<Organism> trk_lines;          // Tracked lineages progenitors
-  std::vector<Organism> wld_lines;          // Tracked lineages progenitors
+  State_array<double> sum_sq_b_rates;       // sum of squared birth rates for computing variance[br]
+  State_array<double> tot_rates;            // Each states tot event rate 
+  State_array<Genotype_lists> orgs;         // Lineage of each org in pop., by state and genotype
+  static const int linear_scan_states = 8;  // more states than this: pick states from the trees
+  bool state_trees_on;                      // num_states() > linear_scan_states
+  Sum_tree<double> state_rate_tree;         // tot_rates[st], to pick an event's state
+  Sum_tree<int>    state_count_tree;        // orgs[st].size(), to pick a random org's state
+  bool nr_valid;                            // next_times hold for the current rates
+  double nr_time;                           // clock of the next-reaction steps
+  Indexed_heap next_times;                  // putative firing time of each channel
+  std::vector<double> chan_rates;           // rate of each channel when its time was set
+  std::vector<Lineage_id> trk_lines;        // Tracked lineages
+  std::vector<Lineage_id> wld_lines;        // Wild lineages
+  Lineage_pool lineages;                    // Data of every lineage in trk_lines and wld_lines
+  mutable Rng rand_gen;                     // mutable so const rnd_org() can draw from it
   
   double tot_event_rate;     // Total rate an internally handled event happens 
 
@@ -109,14 +177,31 @@ private:
   int n_trk_deaths;
   int n_trk_state_chg;
   
+  static int num_states() {return NStates ? NStates : Organism::num_states(); };
+  bool state_trees() const {                // state_trees_on, known at compile time if it can be
+    return NStates ? NStates > linear_scan_states : state_trees_on;
+  };
+  template<class T> static State_array<T> new_states() {
+    return State_storage<T, NStates>::make(num_states());
+  };
+
   void death(int state);
   void birth(int state);     // Basic functions by state
-  void state_changer(int state);
-
-  void add_rates(const Organism&, int state);         // Helper functions      
-  void remove_rates(const Organism&, int state);
-  void add_to_lineage_data(Organism&, int state);
-  void remove_from_lineage_data(Organism&, int state);
+  int  state_changer(int state);            // returns the new state
+
+  void add_member(Lineage_id, int state);             // add_org() for an org of a known lineage
+  void push_org(Lineage_id, int state);               // into its genotype's list, updating rates
+  void pop_org(int state, int genotype, int i);       // as swap_pop(orgs[st][g], i), same
+  void update_state_rates(int state);                 // totals from the genotype list sizes
+  int  locate(int state, int& ch) const;              // genotype of state's org ch, ch made its
+                                                      // index in that list
+  void add_to_lineage_data(Lineage_id, int state);
+  void remove_from_lineage_data(Lineage_id, int state);
+  Organism make_org(Lineage_id) const;
+  int rnd_org_state(int& ch) const;                   // state of org ch, ch made its index there
+  double channel_rate(int channel) const;             // 3 * state + 0 birth, 1 death, 2 change
+  void reset_next_times();
+  void update_next_times(int state);                  // after the state's channel rates changed
 
   // Enable reading/writing of object to archive file
   friend class boost::serialization::access;
@@ -124,12 +209,20 @@ private:
   void serialize(Archive & ar, const unsigned int version) {
   ar & b_rate_tots;  
   ar & sum_sq_b_rates;
-  ar & b_rate_ubnds; 
   ar & tot_rates;
   ar & gens;
   ar & orgs;  
+  ar & state_trees_on;
+  ar & state_rate_tree;
+  ar & state_count_tree;
+  ar & nr_valid;
+  ar & nr_time;
+  ar & next_times;
+  ar & chan_rates;
   ar & trk_lines;       
   ar & wld_lines;       
+  ar & lineages;
+  Organism::serialize_states(ar);
   ar & tot_event_rate;
   ar & n_orgs;
   ar & n_births;
@@ -140,162 +233,232 @@ private:
   ar & n_trk_births;
   ar & n_trk_deaths;
   ar & n_trk_state_chg;
+  ar & rand_gen;
   };
 };
 
-inline double Population::event_rate()    const {return tot_event_rate;  };
-inline int    Population::num_orgs()      const {return n_orgs;          };
-inline int    Population::num_births()    const {return n_births;        };
-inline double Population::generations()   const {return gens;            };
-inline int    Population::pop_capacity()  const {return pop_cap;         };
-inline int    Population::num_deaths()    const {return n_deaths;        };
-inline int    Population::num_state_chg() const {return n_state_chg;     };
-inline int    Population::num_trk_orgs()  const {return n_trk_orgs;      };
+template<int N> inline double Basic_population<N>::event_rate()    const {return tot_event_rate;  };
+template<int N> inline int    Basic_population<N>::num_orgs()      const {return n_orgs;          };
+template<int N> inline int    Basic_population<N>::num_births()    const {return n_births;        };
+template<int N> inline double Basic_population<N>::generations()   const {return gens;            };
+template<int N> inline int    Basic_population<N>::pop_capacity()  const {return pop_cap;         };
+template<int N> inline int    Basic_population<N>::num_deaths()    const {return n_deaths;        };
+template<int N> inline int    Basic_population<N>::num_state_chg() const {return n_state_chg;     };
+template<int N> inline int    Basic_population<N>::num_trk_orgs()  const {return n_trk_orgs;      };
 
-inline int Population::num_in_state(int st) const {
+template<int N> inline int Basic_population<N>::num_in_state(int st) const {
   assert(st >= 0);
-  assert(st < Organism::num_states());
-  return orgs[st].size();
+  assert(st < num_states());
+  int n = 0;
+  for (int g = 0; g < num_genotypes; ++g) n += orgs[st][g].size();
+  return n;
 };
 
-inline int Population::num_trk_lineages() const {return trk_lines.size(); };
+template<int N> inline int Basic_population<N>::num_trk_lineages() const {return trk_lines.size(); };
 
-inline int Population::num_lineages()     const {
+template<int N> inline int Basic_population<N>::num_lineages()     const {
   return wld_lines.size() + trk_lines.size();
 };
 
-inline int Population::num_wld_lineages()  const {return wld_lines.size();       };
-inline int Population::num_trk_births()    const {return n_trk_births;           };
-inline int Population::num_trk_deaths()    const {return n_trk_deaths;           };
-inline int Population::num_trk_state_chg() const {return n_trk_state_chg;        };
-inline int Population::num_lethal_muts()   const {return leth_muts;              };
-inline int Population::num_wld_orgs()      const {return n_orgs - n_trk_orgs;    };
-inline int Population::num_wld_births()    const {return n_births - n_trk_births;};
-inline int Population::num_wld_deaths()    const {return n_deaths - n_trk_deaths;};
+template<int N> inline int Basic_population<N>::num_wld_lineages()  const {return wld_lines.size();       };
+template<int N> inline int Basic_population<N>::num_trk_births()    const {return n_trk_births;           };
+template<int N> inline int Basic_population<N>::num_trk_deaths()    const {return n_trk_deaths;           };
+template<int N> inline int Basic_population<N>::num_trk_state_chg() const {return n_trk_state_chg;        };
+template<int N> inline int Basic_population<N>::num_lethal_muts()   const {return leth_muts;              };
+template<int N> inline int Basic_population<N>::num_wld_orgs()      const {return n_orgs - n_trk_orgs;    };
+template<int N> inline int Basic_population<N>::num_wld_births()    const {return n_births - n_trk_births;};
+template<int N> inline int Basic_population<N>::num_wld_deaths()    const {return n_deaths - n_trk_deaths;};
 
 
 
-inline int Population::num_wld_state_chg() const {
+template<int N> inline int Basic_population<N>::num_wld_state_chg() const {
   return n_state_chg - n_trk_state_chg;
 };
 
-inline const Organism& Population::wld_prog(int index) const {
+template<int N> inline Organism Basic_population<N>::make_org(Lineage_id id) const {
+  return Organism(lineages.allele_state(id), lineages.tracked(id), id, &lineages);
+};
+
+template<int N> inline Organism Basic_population<N>::wld_prog(int index) const {
   assert(index < (int) wld_lines.size());
-  return wld_lines[index];
+  return make_org(wld_lines[index]);
 };
 
-inline const Organism& Population::trk_prog(int index) const {
+template<int N> inline Organism Basic_population<N>::trk_prog(int index) const {
   assert(index < (int) trk_lines.size());
-  return trk_lines[index];
+  return make_org(trk_lines[index]);
 };
 
-inline void Population::set_pop_capacity(int p_cap){
+template<int N> inline void Basic_population<N>::set_pop_capacity(int p_cap){
   pop_cap = p_cap;
 };
 
+template<int N> inline void Basic_population<N>::set_rng(const Rng& rng) {rand_gen = rng; nr_valid = false; };
+template<int N> inline Rng& Basic_population<N>::rng()             const {return rand_gen; };
+
+
+template<int N> inline double Basic_population<N>::birth_rate_ubound(int st) const {
+  assert(st >= 0);
+  assert(st < num_states());
+  const Org_state& os = Organism::state(st);
+  double ubnd = 0.0;
+  for (int g = 0; g < num_genotypes; ++g)           // read off the genotypes present in st
+    if (not orgs[st][g].empty() and os.genotype_birth_rate(g) > ubnd) ubnd = os.genotype_birth_rate(g);
+  return ubnd;
+};
 
-inline double Population::org_birth_rate( const Organism& org, int st) const {
-  double fit= Organism::state( st).birth_prefactor();
-  if( org.allele_state() == 1) 
-    fit*= (1+ Organism::state( st).sel_coeff_ben() );
-  else if( org.allele_state() == -1)
-    fit*= (1- Organism::state( st).sel_coeff_del() );
-  return fit;
+template<int N> inline double Basic_population<N>::org_birth_rate( const Organism& org, int st) const {
+  return Organism::state( st).birth_rate( org.allele_state());   // one fitness-table load
 };
+
   
 
-inline void Population::add_to_lineage_data(Organism& org, int st) {
+template<int N> inline void Basic_population<N>::add_to_lineage_data(Lineage_id id, int st) {
   assert(st >= 0);
-  assert(st < Organism::num_states());
-
-  org.inc_num_in_state(st);  
-  org.inc_num_in_lineage();
-  if (org.lineage_index() == -1) {
-    if (org.tracked()) {
-      trk_lines.push_back(org);
-      org.set_lineage_index(trk_lines.size() - 1);
+  assert(st < num_states());
+
+  lineages.inc_num_in_state(id, st);               // also counts the org in the lineage
+  if (lineages.lineage_index(id) == -1) {
+    INSTR_COUNT(line_list_pushes);
+    if (lineages.tracked(id)) {
+      trk_lines.push_back(id);
+      lineages.set_lineage_index(id, trk_lines.size() - 1);
     }
     else {
-      wld_lines.push_back(org);
-      org.set_lineage_index(wld_lines.size() - 1);
+      wld_lines.push_back(id);
+      lineages.set_lineage_index(id, wld_lines.size() - 1);
     };
   };
 };
 
-inline void Population::remove_from_lineage_data(Organism& org, int st) {
+template<int N> inline void Basic_population<N>::remove_from_lineage_data(Lineage_id id, int st) {
   assert(st >= 0);
-  assert(st < Organism::num_states());
-  assert(org.lineage_index() != -1);               // lineage index assigned positive # when added
-  assert(org.num_in_state(st) > 0);                // can't remove an org that isn't there
-  assert(org.num_in_lineage() > 0);
-
-  org.dec_num_in_state(st);
-  org.dec_num_in_lineage();                        // merely reduces a counter
-  if (org.num_in_lineage() == 0) {
-    if (org.tracked()) {
-      assert(org.lineage_index() >= 0);
-      assert(org.lineage_index() < (int) trk_lines.size());
-      trk_lines.back().set_lineage_index(org.lineage_index());
-      swap_pop(trk_lines, org.lineage_index());
-    }
-    else {
-      assert(org.lineage_index() >= 0);
-      if( org.lineage_index() >= (int) wld_lines.size() ){ 
-        cout<<"index= "<<org.lineage_index()<<", wld_lines.size= "<<wld_lines.size()<<endl; };
-        assert(org.lineage_index() < (int) wld_lines.size());
-      wld_lines.back().set_lineage_index(org.lineage_index());
-      swap_pop(wld_lines, org.lineage_index());
-    };
+  assert(st < num_states());
+  assert(lineages.lineage_index(id) != -1);        // lineage index assigned positive # when added
+  assert(lineages.num_in_state(id, st) > 0);       // can't remove an org that isn't there
+
+  lineages.dec_num_in_state(id, st);               // merely reduces counters
+  if (lineages.num_in_lineage(id) == 0) {
+    INSTR_COUNT(line_list_pops);
+    const int index = lineages.lineage_index(id);
+    std::vector<Lineage_id>& lines = lineages.tracked(id) ? trk_lines : wld_lines;
+    assert(index >= 0);
+    assert(index < (int) lines.size());
+    lineages.set_lineage_index(lines.back(), index);
+    swap_pop(lines, index);
+    lineages.release(id);                          // slot reused by the next new lineage
+  };
+};
+
+template<int N> inline void Basic_population<N>::push_org(Lineage_id id, int st) {
+  orgs[st][genotype_index(lineages.allele_state(id))].push_back(id);
+  update_state_rates(st);
+};
+
+template<int N> inline void Basic_population<N>::pop_org(int st, int g, int i) {
+  swap_pop(orgs[st][g], i);
+  update_state_rates(st);
+};
+
+template<int N> inline void Basic_population<N>::update_state_rates(int st) {
+  const Org_state& os = Organism::state(st);
+  double b_tot = 0.0, sq_tot = 0.0;
+  int n = 0;
+  for (int g = 0; g < num_genotypes; ++g) {
+    const double fit = os.genotype_birth_rate(g);
+    const int n_g = orgs[st][g].size();
+    b_tot  += n_g * fit;
+    sq_tot += n_g * fit * fit;
+    n      += n_g;
+  };
+  b_rate_tots[st]    = b_tot;
+  sum_sq_b_rates[st] = sq_tot;
+  tot_rates[st]      = n * (os.chg_rate() + os.death_rate()) + b_tot;
+  if (state_trees()) {
+    state_rate_tree.set(st, tot_rates[st]);
+    state_count_tree.set(st, n);
+  };
+  tot_event_rate = 0.0;                  // summed afresh, not read off the tree's updated nodes
+  for (int s = 0; s < num_states(); ++s) tot_event_rate += tot_rates[s];
+};
+
+template<int N> inline int Basic_population<N>::locate(int st, int& ch) const {
+  int g = 0;
+  while (ch >= (int) orgs[st][g].size()) {
+    ch -= orgs[st][g].size();
+    ++g;
   };
+  assert(g < num_genotypes);
+  return g;
+};
+
+// ch is the index of an org among all n_orgs, counting state 0's first
+template<int N> inline int Basic_population<N>::rnd_org_state(int& ch) const {
+  int st = 0;
+  if (state_trees()) {
+    st = state_count_tree.find(ch);
+    ch -= state_count_tree.prefix(st);
+  }
+  else
+    while (ch >= num_in_state(st)) {
+      ch -= num_in_state(st);
+      ++st;
+    };
+  return st;
 };
 
-inline const Organism& Population::org(int st, int i) const {
+template<int N> inline Organism Basic_population<N>::org(int st, int i) const {
   assert(st >= 0);
-  assert(st <= Organism::num_states());
-  assert(i < (int)orgs[st].size());
+  assert(st <= num_states());
+  assert(i < num_in_state(st));
   
-  return orgs[st][i];
+  const int g = locate(st, i);
+  return make_org(orgs[st][g][i]);
 };
 
-inline const Organism& Population::rnd_org() const {
+template<int N> inline Organism Basic_population<N>::rnd_org() const {
   assert(num_orgs() > 0);
   assert(orgs.size() > 0);
-  int st  = 0;
-  uint ch = rnd_int(n_orgs);
-  while (ch >= orgs[st].size()) {
-    ch -= orgs[st].size();
-    ++st;
-  };
-  return orgs[st][ch];
+  int ch = rnd_int(rand_gen, n_orgs);
+  const int st = rnd_org_state(ch);
+  const int g = locate(st, ch);
+  return make_org(orgs[st][g][ch]);
 };
 
-inline void Population::birth(int st) {
+template<int N> inline void Basic_population<N>::birth(int st) {
+  INSTR_TIME(birth_cycles);
+  INSTR_COUNT(births);
   assert(b_rate_tots[st] > 0);  
-  assert(b_rate_ubnds[st] > 0);
   assert(tot_rates[st] > 0);
   
-  const double ubound = b_rate_ubnds[st];
-  int ch;
-  do ch = rnd_int(orgs[st].size());
-  while ((rnd_uniform() * ubound) > org_birth_rate(orgs[st][ch], st));
-  //  std::cout << "organism number " << ch << std::endl;
+  // Parent's genotype chosen with probability proportional to its orgs' total birth rate, then
+  // the parent uniformly among them.  b_rate_tots[st] is the sum of the same terms, so the loop
+  // only repeats if round-off lands on a genotype with zero birth rate.
+  const Org_state& os = Organism::state(st);
+  const Genotype_lists& lists = orgs[st];
+  int g;
+  do {
+    INSTR_COUNT(birth_draws);
+    double x = rnd_uniform(rand_gen) * b_rate_tots[st];
+    g = 0;
+    while (g < num_genotypes - 1 and (x -= lists[g].size() * os.genotype_birth_rate(g)) >= 0.0)
+      ++g;
+  } while (lists[g].empty() or os.genotype_birth_rate(g) <= 0.0);
   
-  Organism parent= orgs[st][ch];
-  Organism child=  parent;                 // points to same data as parent
-  
-  bool is_lethal=  child.mutate(st);       // Organism::mutate(int) made new pointer if necessary
-  if (is_lethal){
-    ++leth_muts;
-    return;               // If lethal mutation occurred, don't add child (was killed)   
-  };
+  const Lineage_id parent= lists[g][rnd_int(rand_gen, lists[g].size())];
+  const int allele= lineages.allele_state(parent);
+  const bool tracked= lineages.tracked(parent);
   
-  if (child != parent) child.reset_lineage_counts();        // i.e. was make_write_safe() called
+  // Child joins the parent's lineage unless it mutated.  (Lethal mutations are no longer
+  // implemented, see Organism::mutate().)
+  const int child_allele= Organism::mutant_allele(allele, st, rand_gen);
+  const Lineage_id child= (child_allele == allele) ? parent : lineages.create(child_allele, tracked);
   
-  add_org(child, st);
+  add_member(child, st);
   ++n_births;
   gens += (double)1/n_orgs;
   
-  if (parent.tracked()) ++n_trk_births;
+  if (tracked) ++n_trk_births;
 };
 
 /*inline void Population::birth( int st) {
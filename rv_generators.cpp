@@ -2,26 +2,61 @@
 #include "assert.h"
 #include <cmath>
 #include <iostream>
+#include <algorithm>
 
 namespace evolve{
 
-int rnd_binomial(double pp, int xn) {       // pp =probability heads, xn= # flips
+namespace {
+  unsigned long long splitmix64(unsigned long long& z) {
+    unsigned long long r= ( z+= 0x9E3779B97F4A7C15ULL);
+    r= ( r^ ( r>> 30) )* 0xBF58476D1CE4E5B9ULL;
+    r= ( r^ ( r>> 27) )* 0x94D049BB133111EBULL;
+    return r^ ( r>> 31);
+  };
+}
+
+// ***************************** Rng constructors *****************************
+Rng::Rng()                                                   {seed(0, 0);                };
+Rng::Rng(unsigned long long sd)                              {seed(sd, 0);               };
+Rng::Rng(unsigned long long master_seed, unsigned long long stream) {seed(master_seed, stream);};
+
+void Rng::seed(unsigned long long master_seed, unsigned long long stream) {
+  unsigned long long z= master_seed;              // mix seed and stream number, then expand
+  z= splitmix64( z)^ stream;                      // with splitmix64 as the xoshiro authors advise
+  for( int i= 0; i< 4; ++i) s[i]= splitmix64( z);
+  gauss_iset= 0;
+  gauss_gset= 0.0;
+};
+
+Rng& default_rng() {
+  static thread_local Rng rng;
+  return rng;
+};
+
+void seed_rng(long seed)                            {default_rng()= Rng(seed);         };
+void seed_rng_stream(long master_seed, int stream)  {default_rng()= Rng(master_seed, stream);};
+
+int    rnd_binomial(double pp, int xn)            {return rnd_binomial(default_rng(), pp, xn);};
+int    rnd_poisson(double mean)                   {return rnd_poisson(default_rng(), mean);   };
+double rnd_gaussian(double mean, double stdev)    {return rnd_gaussian(default_rng(), mean, stdev);};
+
+int rnd_binomial(Rng& rng, double pp, int xn) {   // pp =probability heads, xn= # flips
   int j,n;
   double am,em,g,angle,p,bnl,sq,t,y;
-  static double xnold=(-1.0),pold=(-1.0),pc,plog,pclog,oldg;
+  static thread_local double xnold=(-1.0),pold=(-1.0),pc,plog,pclog,oldg;  // per thread, not shared
   p=(pp <= 0.5 ? pp : 1.0-pp);
   am=xn*p;
   if (xn < 25.0) {
     n=((int)(2.0*(xn)) + 1)/2;
     bnl=0.0;
     for (j=1;j<=n;j++)
-      if (drand48() < p) bnl += 1.0;
+      if (rnd_uniform(rng) < p) bnl += 1.0;
   } else if (am < 1.0) {
     n=((int)(2.0*(xn)) + 1)/2;
     g=exp(-am);
     t=1.0;
     for (j=0;j<=n;j++) {
-      t *= drand48();
+      t *= rnd_uniform(rng);
       if (t < g) break;
     }
     bnl=(j <= n ? j : n);
@@ -38,31 +73,77 @@ int rnd_binomial(double pp, int xn) {       // pp =probability heads, xn= # flip
     sq=sqrt(2.0*am*pc);
     do {
       do {
-	angle=3.14159265358979323846*drand48();
+	angle=3.14159265358979323846*rnd_uniform(rng);
 	y=tan(angle);
 	em=sq*y+am;
       } while (em < 0.0 || em >= (xn+1.0));
       em=floor(em);
       t=1.2*sq*(1.0+y*y)*exp(oldg-lgamma(em+1.0)
 			     -lgamma(xn-em+1.0)+em*plog+(xn-em)*pclog);
-    } while (drand48() > t);
+    } while (rnd_uniform(rng) > t);
     bnl=em;
   }
   if (p != pp) bnl=xn-bnl;
   return (int) bnl;
 };
 
-double rnd_gaussian(double mean, double stdev) {
+int rnd_poisson(Rng& rng, double xm) {      // xm = mean
+  double em,t,y,sq,alxm,g;
+  assert(xm >= 0.0);
+  if (xm < 12.0) {                          // multiply uniforms until below exp(-mean)
+    g=exp(-xm);
+    em = -1;
+    t=1.0;
+    do {
+      ++em;
+      t *= rnd_uniform(rng);
+    } while (t > g);
+  } else {                                  // rejection from a Lorentzian
+    sq=sqrt(2.0*xm);
+    alxm=log(xm);
+    g=xm*alxm-lgamma(xm+1.0);
+    do {
+      do {
+	y=tan(3.14159265358979323846*rnd_uniform(rng));
+	em=sq*y+xm;
+      } while (em < 0.0);
+      em=floor(em);
+      t=0.9*(1.0+y*y)*exp(em*alxm-lgamma(em+1.0)-g);
+    } while (rnd_uniform(rng) > t);
+  }
+  return (int) em;
+};
+
+// n draws over categories with probabilities proportional to weights, by conditional binomials
+void rnd_multinomial(Rng& rng, int n, const std::vector<double>& weights, std::vector<int>& out) {
+  double left= 0.0;
+  int last= -1;                                  // last category with positive weight takes the rest
+  for( unsigned int k= 0; k< weights.size(); ++k) 
+    if( weights[ k]> 0.0) {
+      left+= weights[ k];
+      last= k;
+    };
+  out.assign( weights.size(), 0);
+  for( int k= 0; k< last and n> 0; ++k) {
+    if( weights[ k]<= 0.0) continue;
+    out[ k]= rnd_binomial( rng, std::min( 1.0, weights[ k]/ left), n);
+    n-= out[ k];
+    left-= weights[ k];
+  };
+  if( last>= 0) out[ last]= n;
+};
+
+double rnd_gaussian(Rng& rng, double mean, double stdev) {
 
-  static int iset=0;
-  static double gset;
+  int& iset= rng.gauss_iset;
+  double& gset= rng.gauss_gset;
 
   double fac, rsq, v1, v2;
 
   if( iset== 0) {
     do {
-      v1= 2.0* drand48()- 1.0;
-      v2= 2.0* drand48()- 1.0;
+      v1= 2.0* rnd_uniform(rng)- 1.0;
+      v2= 2.0* rnd_uniform(rng)- 1.0;
 
       rsq= v1*v1 + v2*v2;
 
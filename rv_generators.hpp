@@ -4,20 +4,91 @@
 #include <cmath>
 #include <iostream>
 #include <stdlib.h>
+#include <vector>
 
 namespace evolve{
 
+class Rng;
+
+// Samplers drawing from an explicit generator.  Population and Organism use these, so a trial's
+// trajectory depends only on the generator it was given and not on what other threads are doing.
+inline double rnd_uniform( Rng&);
+inline int    rnd_int( Rng&, int N);
+inline double rnd_expo( Rng&, double lambda);
+int           rnd_binomial( Rng&, double pp, int xn);
+int           rnd_poisson( Rng&, double mean);
+double        rnd_gaussian( Rng&, double mean, double stdev);
+void          rnd_multinomial( Rng&, int n, const std::vector<double>& weights, std::vector<int>& out);
+
+// Same samplers drawing from the calling thread's default generator (see seed_rng()).
 inline double rnd_uniform();
 inline int    rnd_int( int N);
 inline double rnd_expo( double lambda);
 int           rnd_binomial( double pp, int xn);
+int           rnd_poisson( double mean);
 double        rnd_gaussian( double mean, double stdev);
 double        rnd_konstantine();  // deltaG drawn from PNAS '07 equilibrium distribution
 
-inline double rnd_uniform()           {return drand48();                   };
+Rng& default_rng();                           // thread-local generator used by the samplers above
+void seed_rng(long seed);                     // seeds the calling thread's default generator
+void seed_rng_stream(long master_seed, int stream);
+
+
+// ****************************************************************************
+// ***********************             Rng              ***********************
+// ****************************************************************************
+// xoshiro256** generator.  Rng(master_seed, stream) hashes both numbers into the initial state,
+// so trials seeded with the same master seed and distinct stream numbers get independent,
+// reproducible sequences.  Objects are cheap to copy and hold no shared state.
+class Rng {
+public:
+  Rng();                                          // fixed default seed
+  explicit Rng(unsigned long long seed);
+  Rng(unsigned long long master_seed, unsigned long long stream);
+
+  unsigned long long next();                      // 64 random bits
+  double uniform();                               // uniform on [0,1), 53-bit resolution
+
+  // Enable reading/writing of object to archive file (public so this header needs no boost)
+  template<class Archive>
+  void serialize(Archive & ar, const unsigned int version) {
+    ar & s;
+    ar & gauss_iset;
+    ar & gauss_gset;
+  };
+
+  friend double rnd_gaussian( Rng&, double, double);
+private:
+  unsigned long long s[4];
+  int    gauss_iset;                               // rnd_gaussian() makes normals in pairs, the
+  double gauss_gset;                               // second is cached here for the next call
+
+  void seed(unsigned long long master_seed, unsigned long long stream);
+};
+
+inline unsigned long long Rng::next() {
+  const unsigned long long x= s[1]* 5;
+  const unsigned long long result= ( ( x<< 7)| ( x>> 57) )* 9;
+  const unsigned long long t= s[1]<< 17;
+  s[2]^= s[0];
+  s[3]^= s[1];
+  s[1]^= s[2];
+  s[0]^= s[3];
+  s[2]^= t;
+  s[3]= ( s[3]<< 45)| ( s[3]>> 19);
+  return result;
+};
+
+inline double Rng::uniform() {return ( next()>> 11)* ( 1.0/ 9007199254740992.0); }; // / 2^53
+
+inline double rnd_uniform(Rng& rng)                {return rng.uniform();                    };
+inline int    rnd_int(Rng& rng, int N)             {return (int)(rng.uniform()*N);           };
+inline double rnd_expo(Rng& rng, double lambda)    {return -log(rnd_uniform(rng)) / lambda;  };
+
+inline double rnd_uniform()           {return rnd_uniform(default_rng());      };
 //inline double rnd_uniform()           {return gsl_rng_uniform(BaseRand); };
-inline int    rnd_int(int N)          {return (int)(drand48()*N);          };
-inline double rnd_expo(double lambda) {return -log(rnd_uniform()) / lambda;};
+inline int    rnd_int(int N)          {return rnd_int(default_rng(), N);       };
+inline double rnd_expo(double lambda) {return rnd_expo(default_rng(), lambda); };
 
 }
 
@@ -0,0 +1,71 @@
+//  Spsc_queue is a bounded, lock-free queue for exactly one producer thread and one consumer thread,
+//  used to hand trajectory blocks to a writer thread (trajectory.hpp).
+//
+//  Items are exchanged by swap: try_push() leaves the slot's previous contents (e.g. an emptied
+//  buffer with its capacity) in the producer's item, and try_pop() leaves its item in the slot.
+//  Buffers are thus recycled between the two threads instead of reallocated.
+
+
+#ifndef _SPSC_QUEUE_
+#define _SPSC_QUEUE_
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <assert.h>
+
+namespace evolve {
+
+template<typename T>
+class Spsc_queue {
+public:
+  explicit Spsc_queue(int capacity= 8);          // rounded up to a power of 2
+
+  bool try_push(T& item);                        // producer only; false if full
+  bool try_pop(T& item);                         // consumer only; false if empty
+  bool empty() const;
+private:
+  std::vector<T> slots;
+  size_t mask;
+  alignas(64) std::atomic<size_t> head;          // next slot to pop, written by the consumer
+  alignas(64) std::atomic<size_t> tail;          // next slot to push, written by the producer
+
+  Spsc_queue(const Spsc_queue&);
+  Spsc_queue& operator=(const Spsc_queue&);
+};
+
+template<typename T>
+Spsc_queue<T>::Spsc_queue(int capacity) : head(0), tail(0) {
+  assert(capacity > 0);
+  size_t size = 1;
+  while (size < (size_t) capacity) size *= 2;
+  slots.resize(size);
+  mask = size - 1;
+};
+
+template<typename T>
+inline bool Spsc_queue<T>::try_push(T& item) {
+  const size_t t = tail.load(std::memory_order_relaxed);
+  if (t - head.load(std::memory_order_acquire) > mask) return false;
+  std::swap(slots[t & mask], item);
+  tail.store(t + 1, std::memory_order_release);
+  return true;
+};
+
+template<typename T>
+inline bool Spsc_queue<T>::try_pop(T& item) {
+  const size_t h = head.load(std::memory_order_relaxed);
+  if (h == tail.load(std::memory_order_acquire)) return false;
+  std::swap(slots[h & mask], item);
+  head.store(h + 1, std::memory_order_release);
+  return true;
+};
+
+template<typename T>
+inline bool Spsc_queue<T>::empty() const {
+  return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+};
+
+} // end namespace block
+
+#endif
@@ -0,0 +1,110 @@
+//  Sum_tree is a Fenwick (binary indexed) tree over a list of non-negative weights.  It supports
+//  the operations Population needs to pick an element with probability proportional to its weight:
+//  appending, changing and removing (by swap with the last element, like swap_pop()) weights, and
+//  finding the element at which a running sum crosses a target.  Each of these costs O(log n).
+
+
+#ifndef _SUM_TREE_
+#define _SUM_TREE_
+
+#include <assert.h>
+#include <vector>
+#include <boost/serialization/vector.hpp>
+
+namespace evolve{
+
+template<typename T>
+class Sum_tree {
+public:
+  int  size()          const {return wts.size(); };
+  T    weight(int i)   const;
+  T    total()         const {return prefix(size()); };
+  T    prefix(int n)   const;               // sum of the first n weights
+
+  void push_back(T w);
+  void pop_back();
+  void set(int i, T w);
+  void swap_pop(int i);                     // weight i = last weight, then pop_back()
+  void clear()               {wts.clear(); tree.clear(); };
+
+  int  find(T target) const;                // first i with prefix(i + 1) > target
+private:
+  std::vector<T> wts;                       // the weights themselves
+  std::vector<T> tree;                      // tree[k-1] = sum of weights (k - lowbit(k), k]
+
+  static int lowbit(int k) {return k & (-k); };
+
+  // Enable reading/writing of object to archive file
+  friend class boost::serialization::access;
+  template<class Archive>
+  void serialize(Archive & ar, const unsigned int version) {
+    ar & wts;
+    ar & tree;
+  };
+};
+
+template<typename T>
+inline T Sum_tree<T>::weight(int i) const {
+  assert(i >= 0);
+  assert(i < size());
+  return wts[i];
+};
+
+template<typename T>
+T Sum_tree<T>::prefix(int n) const {
+  assert(n >= 0);
+  assert(n <= size());
+  T sum = 0;
+  for (int k = n; k > 0; k -= lowbit(k)) sum += tree[k - 1];
+  return sum;
+};
+
+template<typename T>
+void Sum_tree<T>::push_back(T w) {
+  wts.push_back(w);
+  const int k = wts.size();
+  T node = w;                              // node k covers (k - lowbit(k), k]: add its children
+  for (int j = k - 1; j > k - lowbit(k); j -= lowbit(j)) node += tree[j - 1];
+  tree.push_back(node);
+};
+
+template<typename T>
+void Sum_tree<T>::pop_back() {
+  assert(size() > 0);
+  wts.pop_back();                          // the last node is the only one covering the last weight
+  tree.pop_back();
+};
+
+template<typename T>
+void Sum_tree<T>::set(int i, T w) {
+  assert(i >= 0);
+  assert(i < size());
+  const T diff = w - wts[i];
+  wts[i] = w;
+  for (int k = i + 1; k <= size(); k += lowbit(k)) tree[k - 1] += diff;
+};
+
+template<typename T>
+inline void Sum_tree<T>::swap_pop(int i) {
+  assert(i >= 0);
+  assert(i < size());
+  if (i != size() - 1) set(i, wts.back());
+  pop_back();
+};
+
+template<typename T>
+int Sum_tree<T>::find(T target) const {
+  assert(size() > 0);
+  int step = 1 << (31 - __builtin_clz(size()));   // highest power of 2 <= size()
+  int pos = 0;                             // descend, keeping prefix(pos) <= target
+  for (; step > 0; step /= 2)
+    if (pos + step <= size() and tree[pos + step - 1] <= target) {
+      pos += step;
+      target -= tree[pos - 1];
+    };
+  return (pos < size()) ? pos : size() - 1;  // target >= total only through round-off
+};
+
+} // end namespace block
+
+#endif
@@ -0,0 +1,198 @@
+#include <iostream>
+#include <cstring>
+#include <stdlib.h>
+#include <chrono>
+
+#include "paths.hpp"
+#include TRAJECTORY
+#include ORGANISM
+
+namespace evolve {
+
+namespace {
+const char     traj_magic[8]   = {'E','V','T','R','A','J','B','N'};
+const unsigned traj_version    = 1;
+
+template<typename T> void put(char*& p, T val)        {memcpy(p, &val, sizeof(T)); p += sizeof(T); };
+template<typename T> void get(const char*& p, T& val) {memcpy(&val, p, sizeof(T)); p += sizeof(T); };
+}
+
+int Trajectory_file::record_size(int num_states) {
+  return 4 * sizeof(double) + (3 + num_states) * sizeof(int);
+};
+
+// ***************************** Trajectory_file *****************************
+Trajectory_file::Trajectory_file(std::string filename, bool async) 
+  : out(filename.c_str(), std::ios::binary),
+    n_channels(0),
+    done(false) {
+  if (not out) {
+    std::cout << "Trajectory_file: can't open " << filename << std::endl;
+    abort();
+  };
+  const unsigned n_states = Organism::num_states();
+  out.write(traj_magic, sizeof(traj_magic));
+  out.write(reinterpret_cast<const char*>(&traj_version), sizeof(traj_version));
+  out.write(reinterpret_cast<const char*>(&n_states), sizeof(n_states));
+  
+  if (async) {
+    channels.reset(new Trajectory_channel[max_channels]);
+    writer = std::thread(&Trajectory_file::drain, this);
+  };
+};
+
+Trajectory_file::~Trajectory_file() {
+  if (writer.joinable()) {
+    done = true;
+    writer.join();
+  };
+  out.flush();
+};
+
+// Writer thread: round-robin over the channels, writing blocks as they come, until the file is
+// destroyed and every channel is empty.  Sleeps briefly when there is nothing to write.
+void Trajectory_file::drain() {
+  std::vector<char> block;
+  while (true) {
+    const bool finishing = done;               // read before the last sweep
+    bool wrote = false;
+    const int n = n_channels.load(std::memory_order_acquire);
+    for (int i = 0; i < n; ++i) {
+      Trajectory_channel& chan = channels[i];
+      while (chan.queue.try_pop(block)) {
+        out.write(&block[0], block.size());
+        out.flush();                           // so sync() means "in the file"
+        block.clear();
+        chan.written.fetch_add(1, std::memory_order_release);
+        wrote = true;
+      };
+    };
+    if (finishing and not wrote) break;
+    if (not wrote) std::this_thread::sleep_for(std::chrono::microseconds(50));
+  };
+};
+
+Trajectory_channel* Trajectory_file::open_channel() {
+  if (not channels) return 0;
+  std::lock_guard<std::mutex> guard(lock);     // once per writer, not per block
+  const int n = n_channels.load(std::memory_order_relaxed);
+  for (int i = 0; i < n; ++i)
+    if (not channels[i].in_use) {
+      channels[i].in_use = true;
+      return &channels[i];
+    };
+  if (n == max_channels) {
+    std::cout << "Trajectory_file: more than " << max_channels << " writers at once" << std::endl;
+    abort();
+  };
+  channels[n].in_use = true;
+  n_channels.store(n + 1, std::memory_order_release);
+  return &channels[n];
+};
+
+void Trajectory_file::close_channel(Trajectory_channel* chan) {
+  std::lock_guard<std::mutex> guard(lock);
+  chan->in_use = false;
+};
+
+void Trajectory_file::write(const char* data, size_t bytes) {
+  std::lock_guard<std::mutex> guard(lock);
+  out.write(data, bytes);
+};
+
+void Trajectory_file::flush() {
+  std::lock_guard<std::mutex> guard(lock);
+  out.flush();
+};
+
+// **************************** Trajectory_writer ****************************
+Trajectory_writer::Trajectory_writer(Trajectory_file& f, int trial, int buffer_bytes)
+  : file(f),
+    channel(f.open_channel()),
+    trial_num(trial),
+    buf_bytes(buffer_bytes) {
+  buf.reserve(buf_bytes);
+};
+
+Trajectory_writer::~Trajectory_writer() {
+  flush();
+  if (channel) file.close_channel(channel);
+};
+
+void Trajectory_writer::append(const Trajectory_record& rec) {
+  const int n_states = rec.num_in_state.size();
+  const int rec_bytes = Trajectory_file::record_size(n_states);
+  if ((int) buf.size() + rec_bytes > buf_bytes) flush();
+  
+  const size_t start = buf.size();
+  buf.resize(start + rec_bytes);
+  char* p = &buf[start];
+  put(p, trial_num);
+  put(p, rec.generations);
+  put(p, rec.time);
+  put(p, rec.mean_birth_rate);
+  for (int st = 0; st < n_states; ++st) put(p, rec.num_in_state[st]);
+  put(p, rec.num_trk_orgs);
+  put(p, rec.num_lineages);
+  put(p, rec.mean_sq_birth_rate);
+};
+
+void Trajectory_writer::flush() {
+  if (buf.empty()) return;
+  if (not channel) {
+    file.write(&buf[0], buf.size());
+    buf.clear();
+    return;
+  };
+  while (not channel->queue.try_push(buf))     // queue full: wait for the writer thread
+    std::this_thread::yield();
+  channel->pushed.fetch_add(1, std::memory_order_release);
+  buf.clear();                                 // buf is now a recycled block
+  buf.reserve(buf_bytes);
+};
+
+void Trajectory_writer::sync() {
+  flush();
+  if (not channel) {
+    file.flush();
+    return;
+  };
+  const long pushed = channel->pushed.load(std::memory_order_relaxed);
+  while (channel->written.load(std::memory_order_acquire) < pushed)
+    std::this_thread::yield();
+};
+
+// **************************** Trajectory_reader ****************************
+Trajectory_reader::Trajectory_reader(std::string filename) 
+  : in(filename.c_str(), std::ios::binary),
+    n_states(0) {
+  char magic[sizeof(traj_magic)];
+  unsigned version = 0;
+  unsigned states = 0;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(&version), sizeof(version));
+  in.read(reinterpret_cast<char*>(&states), sizeof(states));
+  if (not in or memcmp(magic, traj_magic, sizeof(magic)) != 0 or version != traj_version) {
+    std::cout << filename << " is not a trajectory file of version " << traj_version << std::endl;
+    abort();
+  };
+  n_states = states;
+  rec_buf.resize(Trajectory_file::record_size(n_states));
+};
+
+bool Trajectory_reader::next(Trajectory_record& rec) {
+  if (not in.read(&rec_buf[0], rec_buf.size())) return false;
+  const char* p = &rec_buf[0];
+  rec.num_in_state.resize(n_states);
+  get(p, rec.trial);
+  get(p, rec.generations);
+  get(p, rec.time);
+  get(p, rec.mean_birth_rate);
+  for (int st = 0; st < n_states; ++st) get(p, rec.num_in_state[st]);
+  get(p, rec.num_trk_orgs);
+  get(p, rec.num_lineages);
+  get(p, rec.mean_sq_birth_rate);
+  return true;
+};
+
+} // end namespace block
@@ -0,0 +1,138 @@
+//  Binary trajectory files, a faster alternative to Write_snapshot's text output.
+//
+//  A trajectory file holds a short header (magic, format version, number of states) followed by
+//  fixed-width records in native byte order, one per snapshot:
+//
+//    trial (int32), generations, time, mean birth rate (doubles), orgs in each state (int32 each),
+//    tracked orgs, lineages (int32), mean squared birth rate (double)
+//
+//  Each trial (or thread) packs its records into its own Trajectory_writer buffer, which goes to
+//  the shared Trajectory_file in one locked write when it is full and when the writer is
+//  destroyed, so records of different trials never interleave within a block and there is no
+//  per-snapshot formatting or flushing.  Trajectory_reader reads the records back, e.g. for the
+//  text converter trajToText (driveTrajToText.cpp).
+//
+//  An asynchronous Trajectory_file does its disk writes on its own writer thread, so disk latency
+//  never stalls a simulation.  Each Trajectory_writer then takes a channel, a lock-free single-
+//  producer queue drained by the writer thread, and blocks go through it instead of a locked write.
+//  A full queue makes the producer wait (backpressure).  Writer::sync() returns once everything
+//  the writer appended is on its way to disk, e.g. as a post_snapshot (Sync_trajectory).  Any
+//  number of simulation threads can feed one file; more writer threads means more files.
+
+
+#ifndef _TRAJECTORY_
+#define _TRAJECTORY_
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+
+#include "paths.hpp"
+#include SPSC_QUEUE
+
+namespace evolve {
+
+// One snapshot, as written to and read from a trajectory file
+struct Trajectory_record {
+  int    trial;
+  double generations;
+  double time;
+  double mean_birth_rate;
+  std::vector<int> num_in_state;
+  int    num_trk_orgs;
+  int    num_lineages;
+  double mean_sq_birth_rate;
+
+  Trajectory_record() 
+    : trial(0), generations(0.0), time(0.0), mean_birth_rate(0.0),
+      num_trk_orgs(0), num_lineages(0), mean_sq_birth_rate(0.0) {};
+};
+
+
+// ****************************************************************************
+// *********************         Trajectory_file          *********************
+// ****************************************************************************
+// Blocks of one producer on their way to an asynchronous file's writer thread
+struct Trajectory_channel {
+  Trajectory_channel() : queue(8), in_use(false), pushed(0), written(0) {};
+  Spsc_queue<std::vector<char> > queue;
+  std::atomic<bool> in_use;                            // taken by a Trajectory_writer
+  std::atomic<long> pushed;                            // blocks queued, by the producer
+  std::atomic<long> written;                           // blocks written, by the writer thread
+};
+
+class Trajectory_file {
+public:
+  explicit Trajectory_file(std::string filename, bool async= false);  // writes the header
+  ~Trajectory_file();                                  // async: drains channels, ends thread
+  
+  void write(const char* data, size_t bytes);          // thread-safe, written as one block
+  void flush();
+  
+  Trajectory_channel* open_channel();                  // 0 unless async
+  void close_channel(Trajectory_channel*);
+  
+  static int record_size(int num_states);              // bytes per record
+  static const int max_channels = 256;                 // producers at once, async only
+private:
+  std::ofstream out;
+  std::mutex    lock;
+
+  std::unique_ptr<Trajectory_channel[]> channels;      // async only
+  std::atomic<int>  n_channels;                        // channels ever opened
+  std::atomic<bool> done;
+  std::thread       writer;
+
+  void drain();                                        // the writer thread
+  Trajectory_file(const Trajectory_file&);
+  Trajectory_file& operator=(const Trajectory_file&);
+};
+
+
+// ****************************************************************************
+// *********************        Trajectory_writer         *********************
+// ****************************************************************************
+class Trajectory_writer {
+public:
+  Trajectory_writer(Trajectory_file&, int trial, int buffer_bytes= 1 << 16);
+  ~Trajectory_writer();                                // flush()
+
+  void append(const Trajectory_record&);               // record's trial is set to this writer's
+  void flush();                                        // hand buffered records to the file
+  void sync();                                         // flush(), then wait until all written
+private:
+  Trajectory_file&    file;
+  Trajectory_channel* channel;                         // 0 for a synchronous file
+  int                 trial_num;
+  std::vector<char>   buf;
+  int                 buf_bytes;
+
+  Trajectory_writer(const Trajectory_writer&);         // owns buffered records, so no copies
+  Trajectory_writer& operator=(const Trajectory_writer&);
+};
+
+
+// ****************************************************************************
+// *********************        Trajectory_reader         *********************
+// ****************************************************************************
+class Trajectory_reader {
+public:
+  explicit Trajectory_reader(std::string filename);    // aborts if not a trajectory file
+  
+  bool next(Trajectory_record&);                       // false at end of file
+  int  num_states() const;
+private:
+  std::ifstream     in;
+  int               n_states;
+  std::vector<char> rec_buf;
+};
+
+inline int Trajectory_reader::num_states() const {return n_states; };
+
+} // end namespace block
+
+#endif
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "paths.hpp"
+#include TRIAL_RUNNER
+
+namespace evolve {
+
+namespace {
+
+// Remaining trials [begin, end) of one worker.  The owner takes from the front, thieves from the back.
+struct Work_block {
+  std::mutex lock;
+  int begin;
+  int end;
+};
+
+bool take_own(Work_block& blk, int& trial) {
+  std::lock_guard<std::mutex> guard(blk.lock);
+  if (blk.begin >= blk.end) return false;
+  trial = blk.begin++;
+  return true;
+};
+
+// Moves the back half of victim's remaining trials into thief's (empty) block
+bool steal(Work_block& victim, Work_block& thief) {
+  int lo, hi;
+  {
+    std::lock_guard<std::mutex> guard(victim.lock);
+    int left = victim.end - victim.begin;
+    if (left <= 0) return false;
+    hi = victim.end;
+    lo = victim.end - (left + 1) / 2;
+    victim.end = lo;
+  }
+  std::lock_guard<std::mutex> guard(thief.lock);
+  thief.begin = lo;
+  thief.end   = hi;
+  return true;
+};
+
+void work(int id, std::vector<Work_block>& blocks, const Trial_fn& trial,
+          std::vector<double>& results) {
+  const int n_blocks = blocks.size();
+  for (;;) {
+    int tr;
+    while (take_own(blocks[id], tr)) results[tr] = trial(tr);
+
+    // Own block is empty: look for a victim.  Trials are never created, so when a full pass
+    // over the other blocks finds nothing to steal all remaining work is in progress elsewhere.
+    bool stolen = false;
+    for (int k = 1; k < n_blocks and not stolen; ++k)
+      stolen = steal(blocks[(id + k) % n_blocks], blocks[id]);
+    if (not stolen) return;
+  };
+};
+
+}  // end unnamed namespace
+
+
+Trial_runner::Trial_runner(int num_threads) : n_threads(num_threads) {
+  assert(num_threads >= 0);
+  if (n_threads == 0) n_threads = std::thread::hardware_concurrency();
+  if (n_threads <= 0) n_threads = 1;
+};
+
+void Trial_runner::run(int num_trials, Trial_fn trial, std::vector<double>& results) const {
+  assert(num_trials >= 0);
+  results.assign(num_trials, 0.0);
+  const int n_workers = std::max(1, std::min(n_threads, num_trials));
+
+  std::vector<Work_block> blocks(n_workers);
+  for (int w = 0; w < n_workers; ++w) {
+    blocks[w].begin = (long) num_trials *  w      / n_workers;
+    blocks[w].end   = (long) num_trials * (w + 1) / n_workers;
+  };
+
+  std::vector<std::thread> workers;
+  for (int w = 1; w < n_workers; ++w)
+    workers.push_back(std::thread(work, w, std::ref(blocks), std::cref(trial), std::ref(results)));
+  work(0, blocks, trial, results);                      // calling thread is worker 0
+  for (unsigned int w = 0; w < workers.size(); ++w) workers[w].join();
+};
+
+} // end namespace block
@@ -0,0 +1,41 @@
+//  Trial_runner spreads independent trials, e.g. the competition experiments of driveCompete.cpp,
+//  over several worker threads.
+//
+//  Each worker owns a contiguous block of trial indices, which it works through from the front.
+//  A worker whose block is exhausted steals the back half of another worker's remaining block.
+//  Trial lengths can differ by orders of magnitude (fixed_or_lost), so static chunking would
+//  leave cores idle while a few long trials finish.
+//
+//  The trial function receives only the trial index and must seed its own random stream from it,
+//  e.g. with Population::set_rng(Rng(master_seed, trial)).  Results are stored by trial index, so
+//  any estimator formed from them is the same whatever the number of threads.
+
+
+#ifndef _TRIAL_RUNNER_
+#define _TRIAL_RUNNER_
+
+#include <vector>
+#include <boost/function.hpp>
+
+namespace evolve {
+
+typedef boost::function<double (int trial)> Trial_fn;  // returns the trial's outcome
+
+class Trial_runner {
+public:
+  explicit Trial_runner(int num_threads= 0);           // 0 means one thread per hardware core
+
+  // Runs trials 0..num_trials-1 and stores the outcome of trial i in results[i].  The trial
+  // function is called concurrently, so it must not touch shared, non-const data.
+  void run(int num_trials, Trial_fn trial, std::vector<double>& results) const;
+
+  int num_threads() const;
+private:
+  int n_threads;
+};
+
+inline int Trial_runner::num_threads() const {return n_threads; };
+
+} // end namespace block
+
+#endif